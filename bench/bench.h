@@ -0,0 +1,202 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Helpers shared by the benchmarks. Every benchmark is a program of its own, see
+// "make bench". Bases are generated into /tmp unless a path is given.
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+const int BENCH_QUESTIONS = 3000;    // distinct questions in a generated base
+
+typedef void (*bench_name_t) (size_t object, char* name, size_t size);
+
+inline double BenchNow ()
+{
+    timespec now = {};
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+// current resident set in KB
+inline long BenchRss ()
+{
+    FILE* status = fopen ("/proc/self/status", "r");
+    if (!status) return 0;
+
+    char line[256] = "";
+    long rss = 0;
+
+    while (fgets (line, sizeof (line), status))
+    {
+        if (strncmp (line, "VmRSS:", 6) == 0) rss = atol (line + 6);
+    }
+
+    fclose (status);
+
+    return rss;
+}
+
+inline unsigned long long BenchRandom ()
+{
+    static unsigned long long state = 88172645463325252ull;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    return state;
+}
+
+// Runs the function in a child process and returns the child's peak RSS in KB,
+// so the measurements of one variant do not inherit the heap of another.
+inline long BenchInChild (void (*run) (void* arg), void* arg)
+{
+    fflush (stdout);
+
+    pid_t pid = fork ();
+    assert (pid >= 0);
+
+    if (pid == 0)
+    {
+        run (arg);
+        fflush (stdout);
+        _exit (0);
+    }
+
+    int status = 0;
+    rusage usage = {};
+    wait4 (pid, &status, 0, &usage);
+
+    return usage.ru_maxrss;
+}
+
+// write syscalls the process has made so far, 0 without /proc/self/io
+inline long long BenchWriteCalls ()
+{
+    FILE* io = fopen ("/proc/self/io", "r");
+    if (!io) return 0;
+
+    char      line[256] = "";
+    long long calls     = 0;
+
+    while (fgets (line, sizeof (line), io))
+    {
+        if (strncmp (line, "syscw:", 6) == 0) calls = atoll (line + 6);
+    }
+
+    fclose (io);
+
+    return calls;
+}
+
+// Drops the page cache so the next read of a file comes from the disk. Needs root,
+// returns false if it is not allowed and the files stay cached.
+inline bool BenchDropCaches ()
+{
+    sync ();
+
+    FILE* drop = fopen ("/proc/sys/vm/drop_caches", "w");
+    if (!drop) return false;
+
+    bool dropped = fputs ("3\n", drop) >= 0;
+
+    return (fclose (drop) == 0) && dropped;
+}
+
+// file size in bytes, 0 if there is no such file
+inline long long BenchFileSize (const char* path)
+{
+    FILE* file = fopen (path, "rb");
+    if (!file) return 0;
+
+    fseek (file, 0, SEEK_END);
+    long long size = ftell (file);
+    fclose (file);
+
+    return size;
+}
+
+inline void WriteTabs (FILE* file, int level)
+{
+    for (int i = 0; i < level; i++) fputc ('\t', file);
+}
+
+inline void ObjectNumberName (size_t object, char* name, size_t size)
+{
+    snprintf (name, size, "Объект %zu", object);
+}
+
+// Writes a complete tree of the given depth in the text format: 2^depth objects
+// with distinct names under questions taken from a fixed pool.
+inline void WriteBalancedBase (const char* path, int depth, bench_name_t object_name = ObjectNumberName)
+{
+    FILE* file = fopen (path, "w");
+    assert (file);
+
+    // one open node per level, the way down is the binary number of the object
+    size_t objects = (size_t) 1 << depth;
+
+    for (size_t object = 0; object < objects; object++)
+    {
+        // the levels that open here are the trailing zero bits of the number
+        int opened = (object == 0) ? depth : __builtin_ctzll (object);
+
+        for (int level = depth - opened; level < depth; level++)
+        {
+            WriteTabs (file, level);
+            fputs ("(\n", file);
+            WriteTabs (file, level + 1);
+            fprintf (file, "Вопрос номер %d: это можно проиграть?\n", (int) (BenchRandom () % BENCH_QUESTIONS));
+        }
+
+        char name[256] = "";
+        object_name (object, name, sizeof (name));
+
+        WriteTabs (file, depth);
+        fputs ("(\n", file);
+        WriteTabs (file, depth + 1);
+        fprintf (file, "%s\n", name);
+        WriteTabs (file, depth);
+        fputs (")\n", file);
+
+        int closed = (object + 1 == objects) ? depth : __builtin_ctzll (object + 1);
+
+        for (int level = depth - 1; level >= depth - closed; level--)
+        {
+            WriteTabs (file, level);
+            fputs (")\n", file);
+        }
+    }
+
+    fclose (file);
+}
+
+// Writes a chain of questions, each with an object on the right and the rest of the
+// chain on the left, like a base that always learned in the same direction.
+inline void WriteChainBase (const char* path, size_t depth)
+{
+    FILE* file = fopen (path, "w");
+    assert (file);
+
+    for (size_t level = 0; level < depth; level++)
+    {
+        fprintf (file, "(\nВопрос %zu?\n(\nОбъект %zu\n)\n", level, level);
+    }
+
+    fputs ("(\nПоследний объект\n)\n", file);
+
+    for (size_t level = 0; level < depth; level++) fputs (")\n", file);
+
+    fclose (file);
+}
+
+#endif
@@ -0,0 +1,73 @@
+// Start-up time of the game: LoadTree of a text base and of the same base in the
+// binary format, from a fresh process. "Cold" drops the page cache first, so the
+// file comes from the disk; "warm" reads it from the cache right after that.
+//
+//   bench/bin/cold_start [largest depth]    (depths 9, 16 and 22 are about 10^3,
+//                                            10^5 and 10^7 nodes)
+
+#include "akinator.h"
+#include "bench.h"
+
+static const char* const TextPath   = "/tmp/bench_cold.txt";
+static const char* const BinaryPath = "/tmp/bench_cold.bin";
+
+static const int DEPTHS[] = {9, 16, 22};
+
+static void RunLoad (void* path)
+{
+    double start = BenchNow ();
+
+    Tree tree = {};
+    if (!LoadTree (&tree, (const char*) path))
+    {
+        printf ("could not load %s\n", (const char*) path);
+        return;
+    }
+
+    printf ("%8.3f s", BenchNow () - start);
+
+    TreeDtor (&tree);
+}
+
+static void Measure (const char* title, const char* path)
+{
+    printf ("    %-6s %5lld MB, cold", title, BenchFileSize (path) >> 20);
+
+    bool dropped = BenchDropCaches ();
+    long peak    = BenchInChild (RunLoad, (void*) path);
+
+    printf ("%s, warm", dropped ? "" : " (cache not dropped)");
+    BenchInChild (RunLoad, (void*) path);
+
+    printf (", peak RSS %ld MB\n", peak / 1024);
+}
+
+int main (int argc, const char** argv)
+{
+    int largest = (argc > 1) ? atoi (argv[1]) : 22;
+
+    for (size_t i = 0; i < sizeof (DEPTHS) / sizeof (DEPTHS[0]) && DEPTHS[i] <= largest; i++)
+    {
+        WriteBalancedBase (TextPath, DEPTHS[i]);
+
+        Tree tree = {};
+        bool converted = LoadTree (&tree, TextPath) && SaveTree (&tree, BinaryPath, BINARY_BASE);
+        TreeDtor (&tree);
+
+        if (!converted)
+        {
+            printf ("could not convert %s\n", TextPath);
+            return 1;
+        }
+
+        printf ("cold_start: depth %d, %zu nodes\n", DEPTHS[i], ((size_t) 2 << DEPTHS[i]) - 1);
+
+        Measure ("text",   TextPath);
+        Measure ("binary", BinaryPath);
+    }
+
+    remove (TextPath);
+    remove (BinaryPath);
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+// CommonAncestor along the jump pointers against the climb along parent pointers it
+// replaced, on random pairs of leaves of a balanced base and of a chain. Every answer,
+// with both children, is checked against the climb.
+//
+//   bench/bin/lca [depth of the balanced base] [length of the chain] [pairs]
+
+#include "akinator.h"
+#include "bench.h"
+
+static const char* BasePath = "/tmp/bench_lca.txt";
+
+static Node* OldCommonAncestor (Node* node_1, Node* node_2, Node** child_1, Node** child_2)
+{
+    *child_1 = nullptr;
+    *child_2 = nullptr;
+
+    while (node_1->depth > node_2->depth)
+    {
+        *child_1 = node_1;
+        node_1   = node_1->parent;
+    }
+
+    while (node_2->depth > node_1->depth)
+    {
+        *child_2 = node_2;
+        node_2   = node_2->parent;
+    }
+
+    while (node_1 != node_2)
+    {
+        *child_1 = node_1;
+        *child_2 = node_2;
+
+        node_1 = node_1->parent;
+        node_2 = node_2->parent;
+    }
+
+    return node_1;
+}
+
+static void Compare (const char* title, size_t pairs)
+{
+    Tree tree = {};
+    if (!LoadTree (&tree, BasePath))
+    {
+        printf ("could not load %s\n", BasePath);
+        return;
+    }
+
+    size_t leaves_num = 0;
+    size_t max_depth  = 0;
+
+    for (Node* node = tree.root; node; node = NextPreOrder (node, tree.root, SIZE_MAX, RIGHT))
+    {
+        if (!node->left) leaves_num++;
+        if (node->depth > max_depth) max_depth = node->depth;
+    }
+
+    Node** leaves = (Node**) calloc (leaves_num, sizeof (Node*));
+    Node** pair   = (Node**) calloc (2 * pairs, sizeof (Node*));
+    assert (leaves && pair);
+
+    size_t leaf = 0;
+    for (Node* node = tree.root; node; node = NextPreOrder (node, tree.root, SIZE_MAX, RIGHT))
+    {
+        if (!node->left) leaves[leaf++] = node;
+    }
+
+    for (size_t i = 0; i < 2 * pairs; i++) pair[i] = leaves[BenchRandom () % leaves_num];
+
+    Node*  child_1 = nullptr;
+    Node*  child_2 = nullptr;
+    size_t sum     = 0;    // keeps the calls from being optimized out
+
+    double start = BenchNow ();
+    for (size_t i = 0; i < pairs; i++) sum += OldCommonAncestor (pair[2 * i], pair[2 * i + 1], &child_1, &child_2)->depth;
+    double old_time = BenchNow () - start;
+
+    start = BenchNow ();
+    for (size_t i = 0; i < pairs; i++) sum += CommonAncestor (pair[2 * i], pair[2 * i + 1], &child_1, &child_2)->depth;
+    double new_time = BenchNow () - start;
+
+    size_t wrong = 0;
+
+    for (size_t i = 0; i < pairs; i++)
+    {
+        Node* old_child_1 = nullptr;
+        Node* old_child_2 = nullptr;
+
+        Node* old_common = OldCommonAncestor (pair[2 * i], pair[2 * i + 1], &old_child_1, &old_child_2);
+        Node* common     = CommonAncestor    (pair[2 * i], pair[2 * i + 1], &child_1,     &child_2);
+
+        if (common != old_common || child_1 != old_child_1 || child_2 != old_child_2) wrong++;
+    }
+
+    printf ("%s, %zu leaves, depth %zu: parent pointers %.0f ns, jump pointers %.0f ns, %zu wrong (%zu)\n",
+            title, leaves_num, max_depth, old_time * 1e9 / (double) pairs, new_time * 1e9 / (double) pairs,
+            wrong, sum % 10);
+
+    free (leaves);
+    free (pair);
+    TreeDtor (&tree);
+}
+
+int main (int argc, const char** argv)
+{
+    int    depth = (argc > 1) ? atoi (argv[1]) : 20;
+    size_t chain = (argc > 2) ? (size_t) atoll (argv[2]) : 100000;
+    size_t pairs = (argc > 3) ? (size_t) atoll (argv[3]) : 100000;
+
+    WriteBalancedBase (BasePath, depth);
+    Compare ("balanced", pairs);
+
+    WriteChainBase (BasePath, chain);
+    Compare ("chain", pairs / 100);
+
+    remove (BasePath);
+
+    return 0;
+}
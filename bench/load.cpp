@@ -0,0 +1,147 @@
+// Load and teardown time and peak RSS of a text base, with the tree allocated from
+// arenas (LoadTree, TreeDtor) and with the layout it had before: one calloc per node
+// and one MAX_NAME_LENGTH calloc per name, freed node by node.
+//
+//   bench/bin/load [depth of the generated base] [base]
+
+#include "akinator.h"
+#include "bench.h"
+#include "utils.h"
+
+#include <cctype>
+
+struct OldNode
+{
+    OldNode* parent;
+    OldNode* right;
+    OldNode* left;
+
+    char* name;
+};
+
+const int MAX_NAME_LENGTH = 100;
+
+static const char* BasePath = "/tmp/bench_load.txt";
+
+static OldNode* OldCreateNode (OldNode* parent, Way mode)
+{
+    OldNode* node = (OldNode*) calloc (1, sizeof (OldNode));
+    assert (node);
+
+    if (mode == LEFT)
+        parent->left  = node;
+    else
+        parent->right = node;
+
+    node->parent = parent;
+    node->name   = (char*) calloc (MAX_NAME_LENGTH, sizeof (char));
+
+    return node;
+}
+
+static void OldTreeDtor (OldNode* node)
+{
+    if (node == nullptr) return;
+
+    free (node->name);
+
+    OldTreeDtor (node->left);
+    free (node->left);
+
+    OldTreeDtor (node->right);
+    free (node->right);
+}
+
+static char* OldGetTree (OldNode* node, char* buffer)
+{
+    while (isspace (*buffer)) buffer++;
+
+    if (*buffer == '(') buffer++;
+
+    for (int i = 0; *buffer != ')' && *buffer != '\0'; buffer++)
+    {
+        if (*buffer == '(')
+        {
+            buffer = OldGetTree (OldCreateNode (node, RIGHT), buffer + 1);
+            buffer = OldGetTree (OldCreateNode (node, LEFT ), buffer + 1);
+        }
+        else
+        {
+            if (isspace (*buffer) && *buffer != ' ') continue;
+            if (i < MAX_NAME_LENGTH - 1) node->name[i++] = *buffer;
+        }
+    }
+
+    return buffer;
+}
+
+static void RunOld (void*)
+{
+    size_t size   = 0;
+    char*  buffer = get_file_content (BasePath, &size);
+    assert (buffer);
+
+    long   rss   = BenchRss ();
+    double start = BenchNow ();
+
+    OldNode* root = (OldNode*) calloc (1, sizeof (OldNode));
+    root->name = (char*) calloc (MAX_NAME_LENGTH, sizeof (char));
+    OldGetTree (root, buffer + 1);
+
+    double loaded = BenchNow ();
+    long   tree   = BenchRss () - rss;
+
+    OldTreeDtor (root);
+    free (root);
+
+    double freed = BenchNow ();
+
+    printf ("calloc per node: load %.3f s, teardown %.3f s, tree %ld MB\n",
+            loaded - start, freed - loaded, tree / 1024);
+
+    free (buffer);
+}
+
+static void RunArena (void*)
+{
+    long   rss   = BenchRss ();
+    double start = BenchNow ();
+
+    Tree tree = {};
+    if (!LoadTree (&tree, BasePath))
+    {
+        printf ("could not load %s\n", BasePath);
+        return;
+    }
+
+    double loaded = BenchNow ();
+    long   used   = BenchRss () - rss;
+
+    TreeDtor (&tree);
+
+    double freed = BenchNow ();
+
+    printf ("arenas:          load %.3f s, teardown %.3f s, tree %ld MB\n",
+            loaded - start, freed - loaded, used / 1024);
+}
+
+int main (int argc, const char** argv)
+{
+    int depth = (argc > 1) ? atoi (argv[1]) : 20;
+
+    if (argc > 2)
+        BasePath = argv[2];
+    else
+        WriteBalancedBase (BasePath, depth);
+
+    printf ("load: %s\n", BasePath);
+
+    long old_peak   = BenchInChild (RunOld,   nullptr);
+    long arena_peak = BenchInChild (RunArena, nullptr);
+
+    printf ("peak RSS: calloc per node %ld MB, arenas %ld MB\n", old_peak / 1024, arena_peak / 1024);
+
+    if (argc <= 2) remove (BasePath);
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Time and write syscalls of saving a text base: the buffered writer (PrintTree,
+// SaveTree) against the old PrintTree, which made one fprintf per tab and two more
+// per line. Both are followed by fflush and fsync, like in SaveTree. "Buffered" goes
+// through the buffer of stdio as well, which SaveTree turns off for text bases.
+//
+//   bench/bin/save [depth of the generated base] [runs]
+
+#include "akinator.h"
+#include "bench.h"
+
+#include <unistd.h>
+
+static const char* const BasePath = "/tmp/bench_save.txt";
+static const char* const SavePath = "/tmp/bench_save_saved.txt";
+
+static void OldPrintTabs (FILE* file, int level)
+{
+    for (int i = 0; i < level; i++) fprintf (file, "\t");
+}
+
+static void OldPrintTree (Node* node, FILE* file, int level)
+{
+    Node* cur = node;
+
+    while (true)
+    {
+        OldPrintTabs (file, level);
+        fprintf (file, "(\n");
+
+        OldPrintTabs (file, level);
+        fprintf (file, "%.*s\n", NODE_NAME (cur));
+
+        if (cur->right || cur->left)
+        {
+            cur = cur->right ? cur->right : cur->left;
+            level++;
+            continue;
+        }
+
+        while (true)
+        {
+            OldPrintTabs (file, level);
+            fprintf (file, ")\n");
+
+            if (cur == node) return;
+
+            Node* parent = cur->parent;
+            level--;
+
+            if (cur == parent->right && parent->left)
+            {
+                cur = parent->left;
+                level++;
+                break;
+            }
+
+            cur = parent;
+        }
+    }
+}
+
+static void Report (const char* title, double time, long long calls)
+{
+    printf ("    %-20s %7.3f s %9lld writes  %6lld MB\n", title, time, calls, BenchFileSize (SavePath) >> 20);
+}
+
+static void SaveOld (Tree* tree)
+{
+    long long calls = BenchWriteCalls ();
+    double    start = BenchNow ();
+
+    FILE* file = fopen (SavePath, "w");
+    assert (file);
+
+    OldPrintTree (tree->root, file, 0);
+    fflush (file);
+    fsync (fileno (file));
+    fclose (file);
+
+    Report ("old PrintTree", BenchNow () - start, BenchWriteCalls () - calls);
+}
+
+static void SaveNew (Tree* tree)
+{
+    long long calls = BenchWriteCalls ();
+    double    start = BenchNow ();
+
+    FILE* file = fopen (SavePath, "w");
+    assert (file);
+
+    Snapshot snapshot = {};
+    TakeSnapshot (tree, &snapshot);
+
+    PrintTree (&snapshot, tree->root, file, 0);
+    fflush (file);
+    fsync (fileno (file));
+    fclose (file);
+
+    ReleaseSnapshot (&snapshot);
+
+    Report ("PrintTree, buffered", BenchNow () - start, BenchWriteCalls () - calls);
+}
+
+static void SaveWhole (Tree* tree)
+{
+    long long calls = BenchWriteCalls ();
+    double    start = BenchNow ();
+
+    SaveTree (tree, SavePath, TEXT_BASE);
+
+    Report ("SaveTree", BenchNow () - start, BenchWriteCalls () - calls);
+}
+
+int main (int argc, const char** argv)
+{
+    int depth = (argc > 1) ? atoi (argv[1]) : 19;
+    int runs  = (argc > 2) ? atoi (argv[2]) : 3;
+
+    WriteBalancedBase (BasePath, depth);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, BasePath))
+    {
+        printf ("could not load %s\n", BasePath);
+        return 1;
+    }
+
+    printf ("save: %zu nodes\n", ((size_t) 2 << depth) - 1);
+
+    for (int run = 0; run < runs; run++)
+    {
+        SaveOld   (&tree);
+        SaveNew   (&tree);
+        SaveWhole (&tree);
+    }
+
+    TreeDtor (&tree);
+
+    remove (BasePath);
+    remove (SavePath);
+
+    return 0;
+}
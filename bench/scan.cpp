@@ -0,0 +1,206 @@
+// Text parsing throughput: the structural index of the scanner against the byte
+// by byte parser it replaced. "Tokenize" only finds the brackets and trims the
+// names, "parse" builds the whole tree with its name index. The scanner parses
+// through LoadTree, which maps the base from the page cache.
+//
+//   bench/bin/scan [depth of the generated base] [base]
+
+#include "akinator.h"
+#include "bench.h"
+#include "scanner.h"
+#include "utils.h"
+
+#include <cctype>
+
+static const char* BasePath = "/tmp/bench_scan.txt";
+
+static char*  Buffer = nullptr;
+static size_t Size   = 0;
+
+static bool OldIsNameSpace (char ch)
+{
+    return isspace (ch) && ch != ' ';
+}
+
+// the old GetName: the name up to the next bracket without whitespace other than ' '
+static const char* OldGetName (Tree* tree, Node* node, const char* buffer, const char* end,
+                               size_t* checksum)
+{
+    const char* name_end = buffer;
+    while (name_end < end && *name_end != '(' && *name_end != ')' && *name_end != '\0')
+    {
+        name_end++;
+    }
+
+    const char* first = buffer;
+    const char* last  = name_end;
+
+    while (first < last && OldIsNameSpace (*first))      first++;
+    while (last > first && OldIsNameSpace (*(last - 1))) last--;
+
+    size_t len = 0;
+    for (const char* ch = first; ch < last; ch++)
+    {
+        if (!OldIsNameSpace (*ch)) len++;
+    }
+
+    *checksum += len;
+
+    if (!tree) return name_end;
+
+    if (len == (size_t) (last - first))
+    {
+        SetNodeName (tree, node, first, len);
+        return name_end;
+    }
+
+    char* name = (char*) calloc (len + 1, sizeof (char));
+    assert (name);
+
+    for (size_t i = 0; first < last; first++)
+    {
+        if (!OldIsNameSpace (*first)) name[i++] = *first;
+    }
+
+    SetNodeName (tree, node, name, len);
+    free (name);
+
+    return name_end;
+}
+
+// the old GetTree, without a tree it only tokenizes; returns the length of all names
+static size_t OldGetTree (Tree* tree, const char* buffer, const char* end)
+{
+    size_t checksum = 0;
+
+    while (buffer < end && isspace (*buffer)) buffer++;
+    if (buffer < end && *buffer == '(') buffer++;
+
+    Node* node = tree ? tree->root : nullptr;
+    buffer = OldGetName (tree, node, buffer, end, &checksum);
+
+    for (; buffer < end; buffer++)
+    {
+        if (*buffer == '(')
+        {
+            if (tree) node = CreateNode (tree, node, node->right ? LEFT : RIGHT);
+            buffer = OldGetName (tree, node, buffer + 1, end, &checksum) - 1;
+        }
+        else if (*buffer == ')')
+        {
+            if (tree && node->parent) node = node->parent;
+        }
+    }
+
+    return checksum;
+}
+
+// the names the way GetTreeText slices them out of the index, their length in all
+static size_t ScanNames (const scan_index* index)
+{
+    size_t checksum = 0;
+    size_t from     = 0;
+
+    for (size_t mark = 0; mark <= index->size; mark++)
+    {
+        size_t to = (mark < index->size) ? index->marks[mark] : index->length;
+
+        if (mark == 0 || Buffer[from - 1] == '(')
+        {
+            size_t first = scan_skip_blanks (index, from, to);
+            size_t last  = scan_trim_blanks (index, first, to);
+
+            checksum += last - first - scan_count_breaks (index, first, last);
+        }
+
+        from = to + 1;
+    }
+
+    return checksum;
+}
+
+static void Report (const char* title, double time, size_t checksum)
+{
+    printf ("    %-22s %7.3f s %7.0f MB/s  (%zu)\n", title, time, (double) Size / 1048576 / time, checksum);
+}
+
+static void RunOldTokenize (void*)
+{
+    double start    = BenchNow ();
+    size_t checksum = OldGetTree (nullptr, Buffer, Buffer + Size);
+
+    Report ("byte by byte, tokenize", BenchNow () - start, checksum);
+}
+
+static void RunScanTokenize (void*)
+{
+    double start = BenchNow ();
+
+    scan_index index = {};
+    if (!scan_build (&index, Buffer, Size, 1)) return;
+
+    double built    = BenchNow ();
+    size_t checksum = ScanNames (&index);
+    double sliced   = BenchNow ();
+
+    Report ("scanner, index only",  built  - start, index.size);
+    Report ("scanner, tokenize",    sliced - start, checksum);
+
+    scan_dtor (&index);
+}
+
+static void RunOldParse (void*)
+{
+    Tree tree = {};
+    TreeCtor (&tree);
+
+    double start = BenchNow ();
+
+    OldGetTree (&tree, Buffer, Buffer + Size);
+    BuildIndex (&tree);
+
+    Report ("byte by byte, parse", BenchNow () - start, tree.index.size);
+
+    TreeDtor (&tree);
+}
+
+static void RunScanParse (void*)
+{
+    Tree tree = {};
+
+    double start = BenchNow ();
+
+    if (!LoadTree (&tree, BasePath)) return;
+
+    Report ("scanner, parse", BenchNow () - start, tree.index.size);
+
+    TreeDtor (&tree);
+}
+
+int main (int argc, const char** argv)
+{
+    int depth = (argc > 1) ? atoi (argv[1]) : 21;
+
+    if (argc > 2)
+        BasePath = argv[2];
+    else
+        WriteBalancedBase (BasePath, depth);
+
+    Buffer = get_file_content (BasePath, &Size);
+    assert (Buffer);
+
+    // LoadTree would split a big base between the cores
+    setenv ("AKINATOR_THREADS", "1", 1);
+
+    printf ("scan: %s, %zu MB, %s\n", BasePath, Size >> 20, scan_kind ());
+
+    BenchInChild (RunOldTokenize,  nullptr);
+    BenchInChild (RunScanTokenize, nullptr);
+    BenchInChild (RunOldParse,     nullptr);
+    BenchInChild (RunScanParse,    nullptr);
+
+    free (Buffer);
+    if (argc <= 2) remove (BasePath);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+// Lookup latency over a base of 2^20 (about 10^6) object names: the exact index,
+// names that differ in case and spaces, names with one wrong letter, names that
+// are not there, and prefixes. Every name is made of five Cyrillic syllables.
+//
+//   bench/bin/search [depth of the generated base] [queries per kind]
+
+#include "akinator.h"
+#include "bench.h"
+#include "search.h"
+
+const size_t SYLLABLES_NUM = 16;
+const size_t SUGGESTIONS   = 5;
+
+static const char* const SYLLABLES[SYLLABLES_NUM] =
+    {"ба", "ве", "ги", "до", "ку", "ла", "ми", "но", "пу", "ра", "се", "ти", "фу", "ха", "це", "чи"};
+
+static const char* const CAPITALS[SYLLABLES_NUM] =
+    {"Ба", "Ве", "Ги", "До", "Ку", "Ла", "Ми", "Но", "Пу", "Ра", "Се", "Ти", "Фу", "Ха", "Це", "Чи"};
+
+// none of them is in a base name
+static const char* const STRANGERS[SYLLABLES_NUM] =
+    {"жо", "зу", "шэ", "щя", "ёю", "гы", "вэ", "бю", "жя", "зэ", "шю", "щы", "ёэ", "гю", "вя", "бы"};
+
+enum QueryKind
+{
+    QUERY_EXACT,
+    QUERY_FOLDED,    // lower case and two spaces
+    QUERY_TYPO,      // one letter replaced
+    QUERY_MISS,
+    QUERY_PREFIX,    // the first word and a half
+    QUERY_KINDS
+};
+
+static const char* const KIND_NAMES[QUERY_KINDS] = {"exact", "case-folded", "one typo", "miss", "prefix"};
+
+// three syllables, a space, two syllables, the object number in base 16
+static void SyllableName (size_t object, char* name, size_t size, const char* const* first,
+                          const char* const* rest, const char* space)
+{
+    snprintf (name, size, "%s%s%s%s%s%s%s",
+              first[(object >> 16) & 15], rest[(object >> 12) & 15], rest[(object >> 8) & 15], space,
+              rest [(object >> 4)  & 15], rest[object & 15], (object >> 20) ? rest[(object >> 20) & 15] : "");
+}
+
+static void ObjectName (size_t object, char* name, size_t size)
+{
+    SyllableName (object, name, size, CAPITALS, SYLLABLES, " ");
+}
+
+static size_t MakeQuery (QueryKind kind, size_t object, char* query, size_t size)
+{
+    switch (kind)
+    {
+        case QUERY_EXACT:  SyllableName (object, query, size, CAPITALS,  SYLLABLES, " ");  break;
+        case QUERY_FOLDED: SyllableName (object, query, size, SYLLABLES, SYLLABLES, "  "); break;
+        case QUERY_MISS:   SyllableName (object, query, size, STRANGERS, STRANGERS, " ");  break;
+
+        case QUERY_TYPO:
+            SyllableName (object, query, size, CAPITALS, SYLLABLES, " ");
+            memcpy (query + 6, "ы", strlen ("ы"));    // the vowel of the second syllable
+            break;
+
+        case QUERY_PREFIX:
+            SyllableName (object, query, size, CAPITALS, SYLLABLES, " ");
+            query[strlen ("Бавеги ку")] = '\0';
+            break;
+
+        default:
+            assert (!"unknown query kind");
+    }
+
+    return strlen (query);
+}
+
+static bool RunQuery (Tree* tree, QueryKind kind, const char* query, size_t len)
+{
+    Node*       leaves[SUGGESTIONS]  = {};
+    SearchMatch matches[SUGGESTIONS] = {};
+
+    switch (kind)
+    {
+        case QUERY_EXACT:  return IndexFind (&tree->index, query, len) != nullptr;
+        case QUERY_PREFIX: return SearchPrefix (tree, query, len, leaves, SUGGESTIONS) > 0;
+
+        case QUERY_FOLDED:
+        case QUERY_TYPO:
+        case QUERY_MISS:
+        default:           return SearchSimilar (tree, query, len, matches, SUGGESTIONS) > 0;
+    }
+}
+
+static int CompareTimes (const void* time_1, const void* time_2)
+{
+    double first  = *(const double*) time_1;
+    double second = *(const double*) time_2;
+
+    return (first > second) - (first < second);
+}
+
+int main (int argc, const char** argv)
+{
+    int    depth   = (argc > 1) ? atoi  (argv[1]) : 20;
+    size_t queries = (argc > 2) ? (size_t) atoll (argv[2]) : 10000;
+
+    const char* base = "/tmp/bench_search.txt";
+    WriteBalancedBase (base, depth, ObjectName);
+
+    Tree   tree  = {};
+    double start = BenchNow ();
+
+    if (!LoadTree (&tree, base))
+    {
+        printf ("could not load %s\n", base);
+        return 1;
+    }
+
+    double loaded = BenchNow ();
+
+    // the first inexact lookup builds the index
+    SearchMatch match = {};
+    SearchSimilar (&tree, "x", 1, &match, 1);
+
+    printf ("search: %zu names, load %.2f s, index build %.2f s\n",
+            (size_t) 1 << depth, loaded - start, BenchNow () - loaded);
+
+    double* times = (double*) calloc (queries, sizeof (double));
+    assert (times);
+
+    for (int kind = 0; kind < QUERY_KINDS; kind++)
+    {
+        size_t found = 0;
+        double total = 0;
+
+        for (size_t i = 0; i < queries; i++)
+        {
+            char   query[256] = "";
+            size_t len = MakeQuery ((QueryKind) kind, BenchRandom () & (((size_t) 1 << depth) - 1),
+                                    query, sizeof (query));
+
+            double query_start = BenchNow ();
+            found   += RunQuery (&tree, (QueryKind) kind, query, len);
+            times[i] = BenchNow () - query_start;
+            total   += times[i];
+        }
+
+        qsort (times, queries, sizeof (double), CompareTimes);
+
+        printf ("%-12s mean %8.2f us, p50 %8.2f us, p99 %8.2f us, found %zu/%zu\n", KIND_NAMES[kind],
+                total / (double) queries * 1e6, times[queries / 2] * 1e6, times[queries * 99 / 100] * 1e6,
+                found, queries);
+    }
+
+    free (times);
+    TreeDtor (&tree);
+    remove (base);
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Cost of the snapshots under a steady stream of SplitLeaf: taking and releasing
+// one, the inserts with and without a save of a snapshot running on another thread,
+// and the memory the inserts add with the save running and without it.
+//
+//   bench/bin/snapshot [depth of the generated base] [inserts] [rounds]
+
+#include "akinator.h"
+#include "bench.h"
+
+#include <atomic>
+#include <thread>
+
+static const char* const BasePath = "/tmp/bench_snapshot.txt";
+static const char* const SavePath = "/tmp/bench_snapshot_saved.txt";
+
+static size_t Inserted = 0;
+
+// a new object under a random leaf, like a game that has guessed wrong
+static void Insert (Tree* tree)
+{
+    Node* node = tree->root;
+    while (node->left) node = (BenchRandom () & 1) ? node->left : node->right;
+
+    char object[64]   = "";
+    char question[64] = "";
+
+    int object_len   = snprintf (object,   sizeof (object),   "Новый объект %zu", Inserted);
+    int question_len = snprintf (question, sizeof (question), "Новый вопрос %zu?", Inserted);
+    Inserted++;
+
+    SplitLeaf (tree, node, object, (size_t) object_len, question, (size_t) question_len);
+}
+
+static void SaveInBackground (Snapshot* snapshot, std::atomic<bool>* done, double* time)
+{
+    double start = BenchNow ();
+
+    SaveSnapshot (snapshot, SavePath, TEXT_BASE);
+
+    *time = BenchNow () - start;
+    done->store (true, std::memory_order_release);
+}
+
+int main (int argc, const char** argv)
+{
+    int    depth   = (argc > 1) ? atoi (argv[1]) : 18;
+    size_t inserts = (argc > 2) ? (size_t) atoll (argv[2]) : 1000000;
+    int    rounds  = (argc > 3) ? atoi (argv[3]) : 3;
+
+    WriteBalancedBase (BasePath, depth);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, BasePath))
+    {
+        printf ("could not load %s\n", BasePath);
+        return 1;
+    }
+
+    printf ("snapshot: 2^%d objects, sizeof (Node) %zu\n", depth, sizeof (Node));
+
+    Snapshot snapshot = {};
+
+    double start = BenchNow ();
+    for (size_t i = 0; i < inserts; i++)
+    {
+        TakeSnapshot (&tree, &snapshot);
+        ReleaseSnapshot (&snapshot);
+    }
+    printf ("    take and release       %8.1f ns\n", (BenchNow () - start) * 1e9 / (double) inserts);
+
+    start = BenchNow ();
+    for (size_t i = 0; i < inserts; i++) Insert (&tree);
+    printf ("    insert, no snapshot    %8.1f ns\n", (BenchNow () - start) * 1e9 / (double) inserts);
+
+    start = BenchNow ();
+    TakeSnapshot (&tree, &snapshot);
+    SaveSnapshot (&snapshot, SavePath, TEXT_BASE);
+    ReleaseSnapshot (&snapshot);
+    printf ("    save, no inserts       %8.3f s, %lld MB\n", BenchNow () - start, BenchFileSize (SavePath) >> 20);
+
+    for (int round = 0; round < rounds; round++)
+    {
+        std::atomic<bool> done (false);
+        double save_time = 0;
+
+        long rss = BenchRss ();
+
+        TakeSnapshot (&tree, &snapshot);
+        std::thread saver (SaveInBackground, &snapshot, &done, &save_time);
+
+        size_t during = 0;
+        start = BenchNow ();
+        while (!done.load (std::memory_order_acquire))
+        {
+            Insert (&tree);
+            during++;
+        }
+        double insert_time = BenchNow () - start;
+
+        saver.join ();
+        ReleaseSnapshot (&snapshot);
+
+        long added = BenchRss () - rss;
+
+        // as many inserts again without a save, for what they add by themselves
+        rss = BenchRss ();
+        for (size_t i = 0; i < during; i++) Insert (&tree);
+        long alone = BenchRss () - rss;
+
+        printf ("    save, inserting        %8.3f s, %zu inserts at %.1f ns, +%ld MB RSS, +%ld MB without the save\n",
+                save_time, during, insert_time * 1e9 / (double) during, added / 1024, alone / 1024);
+    }
+
+    TreeDtor (&tree);
+
+    remove (BasePath);
+    remove (SavePath);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Per-operation cost of the int stack as it grows: n pushes, then n pops.
+// bench/bin/stack is the plain build, bench/bin/stack_hardened is the same code with
+// _DEBUG, _CANARY_PROTECTION and _HASH_PROTECTION, as it runs in production.
+// The plain build also times Stack<int, 64> from small_stack.h with and without
+// the checks.
+//
+//   bench/bin/stack [largest n]
+
+#include "bench.h"
+#include "small_stack.h"
+#include "stack.h"
+
+#ifdef _HASH_PROTECTION
+    static const char* const BUILD = "hardened";
+#else
+    static const char* const BUILD = "plain";
+#endif
+
+static double PushPop (long long n)
+{
+    stack stk = {};
+    STACK_CTOR (&stk);
+
+    elem_t value = 0;
+    double start = BenchNow ();
+
+    for (long long i = 0; i < n; i++) stack_push (&stk, (elem_t) i);
+    for (long long i = 0; i < n; i++) stack_pop  (&stk, &value);
+
+    double time = BenchNow () - start;
+
+    stack_dtor (&stk);
+
+    return time * 1e9 / (double) (2 * n);
+}
+
+template <bool Checked>
+static double StackPushPop (long long n)
+{
+    Stack<elem_t, 64, Checked> stk;
+
+    elem_t value = 0;
+    double start = BenchNow ();
+
+    for (long long i = 0; i < n; i++) stk.push ((elem_t) i);
+    for (long long i = 0; i < n; i++) value += stk.pop ();
+
+    double time = BenchNow () - start;
+
+    // keeps the pops from being optimized out
+    if (value == 1) printf ("\n");
+
+    return time * 1e9 / (double) (2 * n);
+}
+
+static double Best (double (*run) (long long n), long long n, long long repeat)
+{
+    double best = 0;
+
+    for (long long i = 0; i < repeat; i++)
+    {
+        double time = run (n);
+        if (i == 0 || time < best) best = time;
+    }
+
+    return best;
+}
+
+int main (int argc, const char** argv)
+{
+    long long largest = (argc > 1) ? atoll (argv[1]) : 100000;
+
+    for (long long n = 1000; n <= largest; n *= 10)
+    {
+        // the small sizes are repeated to get above the timer resolution
+        long long repeat = largest / n;
+
+        printf ("stack_push/stack_pop, %s, n = %7lld: %8.1f ns/op\n", BUILD, n, Best (PushPop, n, repeat));
+
+#ifndef _DEBUG
+        printf ("Stack<int, 64>, unchecked,  n = %7lld: %8.1f ns/op\n", n, Best (StackPushPop<false>, n, repeat));
+        printf ("Stack<int, 64>, checked,    n = %7lld: %8.1f ns/op\n", n, Best (StackPushPop<true>,  n, repeat));
+#endif
+    }
+
+    return 0;
+}
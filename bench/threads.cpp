@@ -0,0 +1,62 @@
+// Scaling of the parallel text loader and writer over the number of threads,
+// set through AKINATOR_THREADS like for the game. Every run is a process of its own.
+//
+//   bench/bin/threads [depth of the generated base] [most threads]
+
+#include "akinator.h"
+#include "bench.h"
+
+#include <thread>
+
+static const char* const BasePath = "/tmp/bench_threads.txt";
+static const char* const SavePath = "/tmp/bench_threads_saved.txt";
+
+static void RunThreads (void*)
+{
+    double start = BenchNow ();
+
+    Tree tree = {};
+    if (!LoadTree (&tree, BasePath))
+    {
+        printf ("could not load %s\n", BasePath);
+        return;
+    }
+
+    double loaded = BenchNow ();
+
+    SaveTree (&tree, SavePath, TEXT_BASE);
+
+    double saved = BenchNow ();
+
+    printf ("%8.3f s %8.3f s", loaded - start, saved - loaded);
+
+    TreeDtor (&tree);
+    remove (SavePath);
+}
+
+int main (int argc, const char** argv)
+{
+    int    depth   = (argc > 1) ? atoi (argv[1]) : 21;
+    size_t cores   = std::thread::hardware_concurrency ();
+    size_t threads = (argc > 2) ? (size_t) atoll (argv[2]) : ((cores > 4) ? cores : 4);
+
+    WriteBalancedBase (BasePath, depth);
+
+    printf ("threads: %lld MB, %zu cores\n", BenchFileSize (BasePath) >> 20, cores);
+    printf ("    threads     load       save       peak RSS\n");
+
+    for (size_t i = 1; i <= threads; i++)
+    {
+        char env[32] = "";
+        snprintf (env, sizeof (env), "%zu", i);
+        setenv ("AKINATOR_THREADS", env, 1);
+
+        printf ("    %7zu ", i);
+        long peak = BenchInChild (RunThreads, nullptr);
+        printf ("   %5ld MB\n", peak / 1024);
+    }
+
+    remove (BasePath);
+
+    return 0;
+}
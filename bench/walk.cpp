@@ -0,0 +1,89 @@
+// The walks that used to recurse, on the shapes that used to overflow the stack:
+// parse (LoadTree), serialize (SaveTree), dump (TreeDump of the whole tree) and
+// destroy (TreeDtor) of a chain of questions and of a balanced base. "+RSS" is
+// what the step adds to the RSS of the process.
+//
+//   bench/bin/walk [length of the chain] [depth of the balanced base]
+
+#include "akinator.h"
+#include "bench.h"
+
+#include <cstdint>
+
+#include <unistd.h>
+
+static const char* const BasePath  = "/tmp/bench_walk.txt";
+static const char* const SavePath  = "/tmp/bench_walk_saved.txt";
+static const char* const DumpDir   = "/tmp";
+static const char* const DumpFile  = "/tmp/dump.dot";
+
+static void Step (const char* title, double start, long rss_before)
+{
+    printf ("    %-9s %8.3f s, %+6ld MB RSS\n", title, BenchNow () - start, (BenchRss () - rss_before) / 1024);
+}
+
+static void RunWalks (void*)
+{
+    Tree tree = {};
+
+    long   rss   = BenchRss ();
+    double start = BenchNow ();
+    if (!LoadTree (&tree, BasePath))
+    {
+        printf ("could not load %s\n", BasePath);
+        return;
+    }
+    Step ("parse", start, rss);
+
+    rss   = BenchRss ();
+    start = BenchNow ();
+    SaveTree (&tree, SavePath, TEXT_BASE);
+    Step ("serialize", start, rss);
+
+    // only the .dot file is timed, Graphviz is kept from starting on a graph this big
+    setenv ("PATH", "", 1);
+    if (chdir (DumpDir) != 0) return;
+
+    rss   = BenchRss ();
+    start = BenchNow ();
+    TreeDump (&tree, tree.root, SIZE_MAX);
+    Step ("dump", start, rss);
+    printf ("              %lld MB of .dot\n", BenchFileSize (DumpFile) >> 20);
+
+    rss   = BenchRss ();
+    start = BenchNow ();
+    TreeDtor (&tree);
+    Step ("destroy", start, rss);
+
+    remove (SavePath);
+    remove (DumpFile);
+}
+
+static void Measure (const char* title)
+{
+    printf ("%s, %lld MB\n", title, BenchFileSize (BasePath) >> 20);
+
+    long peak = BenchInChild (RunWalks, nullptr);
+
+    printf ("    peak RSS  %ld MB\n", peak / 1024);
+}
+
+int main (int argc, const char** argv)
+{
+    size_t chain = (argc > 1) ? (size_t) atoll (argv[1]) : 10000000;
+    int    depth = (argc > 2) ? atoi (argv[2]) : 22;
+
+    char title[64] = "";
+
+    WriteChainBase (BasePath, chain);
+    snprintf (title, sizeof (title), "chain of %zu questions", chain);
+    Measure (title);
+
+    WriteBalancedBase (BasePath, depth);
+    snprintf (title, sizeof (title), "balanced, depth %d", depth);
+    Measure (title);
+
+    remove (BasePath);
+
+    return 0;
+}
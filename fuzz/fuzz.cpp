@@ -0,0 +1,416 @@
+// Mutation fuzzer for the parsers and the input paths, built with ASan and UBSan
+// by "make fuzz". Every run takes a seed, mutates it and feeds it to one target:
+//
+//   parse    a text or binary base from a buffer with nothing after it
+//   journal  the base with a mutated journal replayed on it
+//   stats    the base with a mutated stats file
+//   session  a game fed with mutated answers, names and questions
+//   batch    a mutated batch command file
+//
+// The seeds are the given text base, the same base saved in the binary format
+// and a chain of FUZZ_CHAIN_DEPTH questions.
+//
+//   fuzz/bin/fuzz target [seconds] [base]
+
+#include "akinator.h"
+#include "batch.h"
+#include "journal.h"
+#include "session.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+const size_t FUZZ_SEEDS       = 3;
+const size_t FUZZ_CHAIN_DEPTH = 300;
+const int    FUZZ_MUTATIONS   = 8;
+
+struct FuzzBuffer
+{
+    char*  data;
+    size_t size;
+    size_t capacity;
+};
+
+static const char* const TOKENS[] = {"(", ")", "\n", "\t", " ", "\r", "да", "нет", "\\", "\\t", "\\n", "L", "R",
+                                     "LR", "describe ", "compare ", "\xff", "\xd0", "AKINBASE", "\x01\x00\x00\x00"};
+
+static const size_t TOKENS_NUM = sizeof (TOKENS) / sizeof (TOKENS[0]);
+
+static char WorkDir[] = "/tmp/akinator_fuzz_XXXXXX";
+
+static size_t Random      (size_t range);
+static void   Reserve     (FuzzBuffer* buffer, size_t size);
+static void   Insert      (FuzzBuffer* buffer, size_t pos, const char* data, size_t size);
+static void   Erase       (FuzzBuffer* buffer, size_t pos, size_t size);
+static void   Assign      (FuzzBuffer* buffer, const char* data, size_t size);
+static void   Mutate      (FuzzBuffer* buffer);
+static void   ReadSeed    (FuzzBuffer* seed, const char* path);
+static void   WriteFile   (const char* path, const FuzzBuffer* buffer);
+static void   WorkPath    (char* path, size_t size, const char* name);
+static void   MakeSeeds   (FuzzBuffer* seeds, const char* base);
+static void   Say         (void* context, const char* text);
+
+static void FuzzParse   (const FuzzBuffer* input);
+static void FuzzReplay  (const FuzzBuffer* input, const FuzzBuffer* base, bool journal);
+static void FuzzSession (const FuzzBuffer* input, Tree* tree);
+static void FuzzBatch   (const FuzzBuffer* input, const char* base);
+
+int main (int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf (stderr, "usage: %s parse|journal|stats|session|batch [seconds] [base]\n", argv[0]);
+        return 1;
+    }
+
+    const char* target  = argv[1];
+    double      seconds = (argc > 2) ? atof (argv[2]) : 10;
+    const char* base    = (argc > 3) ? argv[3] : "base.txt";
+
+    if (!mkdtemp (WorkDir))
+    {
+        perror ("mkdtemp");
+        return 1;
+    }
+
+    FuzzBuffer seeds[FUZZ_SEEDS] = {};
+    MakeSeeds (seeds, base);
+
+    Tree tree = {};
+    if (strcmp (target, "session") == 0 && !LoadTree (&tree, base)) return 1;
+
+    // what the targets print is not checked, only the way to it
+    int out  = dup (STDOUT_FILENO);
+    int null = open ("/dev/null", O_WRONLY);
+    assert (out >= 0 && null >= 0);
+
+    dup2 (null, STDOUT_FILENO);
+    close (null);
+
+    FuzzBuffer input = {};
+    time_t     end   = time (nullptr) + (time_t) seconds;
+    long       runs  = 0;
+
+    for ( ; time (nullptr) < end; runs++)
+    {
+        const FuzzBuffer* seed = &seeds[Random (FUZZ_SEEDS)];
+
+        if (strcmp (target, "parse") == 0)
+        {
+            Assign (&input, seed->data, seed->size);
+            Mutate (&input);
+            FuzzParse (&input);
+        }
+        else if (strcmp (target, "journal") == 0)
+        {
+            const char* records = "RR\tХз\tговорящий\tКот Бегемот\nRRL\tКот Бегемот\tчерный\tКот\nL\tх\tвопрос\tответ\n";
+
+            Assign (&input, records, strlen (records));
+            Mutate (&input);
+            FuzzReplay (&input, &seeds[0], true);
+        }
+        else if (strcmp (target, "stats") == 0)
+        {
+            const char* records = "\t1\t2\t3\t4\nR\t5\t1\t1\t0\nRR\t9\t9\t9\t9\nLLLLLLLL\t1\t1\t1\t1\n";
+
+            Assign (&input, records, strlen (records));
+            Mutate (&input);
+            FuzzReplay (&input, &seeds[0], false);
+        }
+        else if (strcmp (target, "session") == 0)
+        {
+            const char* lines = "да\nнет\nда\nда\nнет\nКот\nговорит\n";
+
+            Assign (&input, lines, strlen (lines));
+            Mutate (&input);
+            FuzzSession (&input, &tree);
+        }
+        else if (strcmp (target, "batch") == 0)
+        {
+            const char* commands = "describe Бладборн\ncompare Бладборн Хз\ndescribe элден  ринг\ncompare Хз хз\n";
+
+            Assign (&input, commands, strlen (commands));
+            Mutate (&input);
+            FuzzBatch (&input, base);
+        }
+        else
+        {
+            fprintf (stderr, "unknown target %s\n", target);
+            return 1;
+        }
+    }
+
+    fflush (stdout);
+    dup2 (out, STDOUT_FILENO);
+    close (out);
+
+    printf ("%s: %ld runs\n", target, runs);
+
+    TreeDtor (&tree);
+
+    for (size_t i = 0; i < FUZZ_SEEDS; i++) free (seeds[i].data);
+    free (input.data);
+
+    char command[sizeof (WorkDir) + 16] = "";
+    snprintf (command, sizeof (command), "rm -rf %s", WorkDir);
+    system (command);
+
+    return 0;
+}
+
+// exactly the size of the input with nothing after it, like a mapped file
+static void FuzzParse (const FuzzBuffer* input)
+{
+    char* buffer = (char*) malloc (input->size ? input->size : 1);
+    assert (buffer);
+    memcpy (buffer, input->data, input->size);
+
+    Tree tree = {};
+    TreeCtor (&tree);
+
+    bool binary = IsBinaryBase (buffer, input->size);
+    bool parsed = binary ? GetTreeBinary (&tree, buffer, input->size)
+                         : GetTreeText   (&tree, buffer, input->size);
+
+    if (parsed)
+    {
+        if (binary) BuildIndex (&tree);
+
+        FILE* null = fopen ("/dev/null", "w");
+        assert (null);
+
+        Snapshot snapshot = {};
+        TakeSnapshot (&tree, &snapshot);
+        PrintTreeText   (&snapshot, null);
+        PrintTreeBinary (&snapshot, snapshot.root, null);
+        ReleaseSnapshot (&snapshot);
+
+        fclose (null);
+    }
+
+    TreeDtor (&tree);
+    free (buffer);
+}
+
+static void FuzzReplay (const FuzzBuffer* input, const FuzzBuffer* base, bool journal)
+{
+    char base_path[256] = "", records_path[256] = "", out_path[256] = "";
+    WorkPath (base_path,    sizeof (base_path),    "base.txt");
+    WorkPath (records_path, sizeof (records_path), journal ? "base.txt.journal" : "base.txt.stats");
+    WorkPath (out_path,     sizeof (out_path),     "out.txt");
+
+    WriteFile (base_path,    base);
+    WriteFile (records_path, input);
+
+    Tree tree = {};
+
+    if (LoadTree (&tree, base_path))
+    {
+        JournalReplay (&tree, base_path);
+        StatsLoad     (&tree, base_path);
+        SaveTree      (&tree, out_path, TEXT_BASE);
+    }
+
+    TreeDtor (&tree);
+    remove (records_path);
+}
+
+// the tree is shared by the runs, so it keeps what the games have taught it
+static void FuzzSession (const FuzzBuffer* input, Tree* tree)
+{
+    Session session = {};
+    SessionStart (&session, tree, Say, nullptr);
+
+    for (size_t pos = 0; pos < input->size && session.state != SESSION_OVER; )
+    {
+        const char* eol = (const char*) memchr (input->data + pos, '\n', input->size - pos);
+        size_t      len = eol ? (size_t) (eol - input->data) - pos : input->size - pos;
+
+        SessionFeed (&session, input->data + pos, len);
+        pos += len + 1;
+    }
+
+    SessionEnd (&session);
+}
+
+static void FuzzBatch (const FuzzBuffer* input, const char* base)
+{
+    char commands_path[256] = "";
+    WorkPath (commands_path, sizeof (commands_path), "commands.txt");
+    WriteFile (commands_path, input);
+
+    RunBatch (base, commands_path);
+}
+
+static void MakeSeeds (FuzzBuffer* seeds, const char* base)
+{
+    ReadSeed (&seeds[0], base);
+
+    char path[256] = "";
+    WorkPath (path, sizeof (path), "seed.bin");
+
+    Tree tree = {};
+    if (LoadTree (&tree, base)) SaveTree (&tree, path, BINARY_BASE);
+    TreeDtor (&tree);
+
+    ReadSeed (&seeds[1], path);
+
+    // deeper than any path of the base, for the code that walks down the tree
+    char line[64] = "";
+
+    for (size_t level = 0; level < FUZZ_CHAIN_DEPTH; level++)
+    {
+        int len = snprintf (line, sizeof (line), "(\n\tВопрос %zu?\n\t(\n\t\tОбъект %zu\n\t)\n", level, level);
+        Insert (&seeds[2], seeds[2].size, line, (size_t) len);
+    }
+
+    Insert (&seeds[2], seeds[2].size, "(\nПоследний\n)\n", strlen ("(\nПоследний\n)\n"));
+
+    for (size_t level = 0; level < FUZZ_CHAIN_DEPTH; level++) Insert (&seeds[2], seeds[2].size, ")\n", 2);
+}
+
+static void Mutate (FuzzBuffer* buffer)
+{
+    int mutations = 1 + (int) Random (FUZZ_MUTATIONS);
+
+    for (int i = 0; i < mutations; i++)
+    {
+        size_t pos = Random (buffer->size + 1);
+
+        switch (Random (7))
+        {
+            case 0:
+                if (buffer->size) buffer->data[Random (buffer->size)] ^= (char) (1 << Random (8));
+                break;
+
+            case 1:
+            {
+                const char* token = TOKENS[Random (TOKENS_NUM)];
+                Insert (buffer, pos, token, strlen (token));
+                break;
+            }
+
+            case 2:
+                if (buffer->size) Erase (buffer, Random (buffer->size), Random (64));
+                break;
+
+            // a piece of the input copied somewhere else
+            case 3:
+                if (buffer->size)
+                {
+                    size_t from = Random (buffer->size);
+                    size_t size = Random (256);
+                    if (size > buffer->size - from) size = buffer->size - from;
+
+                    char* piece = (char*) malloc (size + 1);
+                    assert (piece);
+                    memcpy (piece, buffer->data + from, size);
+
+                    Insert (buffer, pos, piece, size);
+                    free (piece);
+                }
+                break;
+
+            // a run of one letter, longer than any name used to be
+            case 4:
+            {
+                size_t size = Random (3000);
+                char   letter = (char) ('A' + Random (26));
+
+                Insert (buffer, pos, nullptr, size);
+                memset (buffer->data + pos, letter, size);
+                break;
+            }
+
+            case 5:
+                if (buffer->size) buffer->data[Random (buffer->size)] = (char) Random (256);
+                break;
+
+            case 6:
+                if (buffer->size > 8) buffer->size = Random (buffer->size);
+                break;
+
+            default:
+                assert (!"unknown mutation");
+        }
+    }
+}
+
+static size_t Random (size_t range)
+{
+    static unsigned long long state = 24;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    return range ? (size_t) (state % range) : 0;
+}
+
+static void Reserve (FuzzBuffer* buffer, size_t size)
+{
+    if (size <= buffer->capacity) return;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < size) capacity *= 2;
+
+    buffer->data = (char*) realloc (buffer->data, capacity);
+    assert (buffer->data);
+
+    buffer->capacity = capacity;
+}
+
+// data can be nullptr to leave a gap
+static void Insert (FuzzBuffer* buffer, size_t pos, const char* data, size_t size)
+{
+    Reserve (buffer, buffer->size + size);
+
+    memmove (buffer->data + pos + size, buffer->data + pos, buffer->size - pos);
+    if (data) memcpy (buffer->data + pos, data, size);
+
+    buffer->size += size;
+}
+
+static void Erase (FuzzBuffer* buffer, size_t pos, size_t size)
+{
+    if (size > buffer->size - pos) size = buffer->size - pos;
+
+    memmove (buffer->data + pos, buffer->data + pos + size, buffer->size - pos - size);
+    buffer->size -= size;
+}
+
+static void Assign (FuzzBuffer* buffer, const char* data, size_t size)
+{
+    buffer->size = 0;
+    Insert (buffer, 0, data, size);
+}
+
+static void ReadSeed (FuzzBuffer* seed, const char* path)
+{
+    size_t size = 0;
+    char*  data = get_file_content (path, &size);
+
+    if (data) Assign (seed, data, size);
+    free (data);
+}
+
+static void WriteFile (const char* path, const FuzzBuffer* buffer)
+{
+    FILE* file = fopen (path, "wb");
+    assert (file);
+
+    fwrite (buffer->data, 1, buffer->size, file);
+    fclose (file);
+}
+
+static void WorkPath (char* path, size_t size, const char* name)
+{
+    snprintf (path, size, "%s/%s", WorkDir, name);
+}
+
+static void Say (void*, const char*) {}
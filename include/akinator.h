@@ -4,6 +4,14 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstdio>
+#include <cstdint>
+
+#include "arena.h"
+#include "intern.h"
+#include "small_stack.h"
+
+struct Journal;
+struct NameSearch;
 
 enum Way
 {
@@ -11,18 +19,139 @@ enum Way
     RIGHT
 };
 
+// paths deeper than this spill to the heap
+const size_t PATH_INLINE_DEPTH = 64;
+
+typedef Stack<Way, PATH_INLINE_DEPTH> PathStack;
+
+enum StatsEvent
+{
+    STATS_REACHED,
+    STATS_YES,
+    STATS_NO,
+    STATS_WRONG,        // the leaf was guessed wrong and a new object was learned
+    STATS_QUESTIONS,    // asked in the games that ended at the leaf, as many as there were then
+    STATS_EVENTS
+};
+
+struct NodeStats
+{
+    uint64_t counters[STATS_EVENTS];
+};
+
 struct Node
 {
     Node* parent;
     Node* right;
     Node* left;
+    Node* jump;        // an ancestor for the O(log depth) climbs, see SetJump
+
+    uint32_t name;     // id in the string table
+    uint32_t split;    // the version the leaf became a question in, 0 if it was loaded as one
+
+    size_t depth;
+
+    NodeStats* stats;    // nullptr until the node is hit for the first time
+};
+
+#define NODE_NAME(node) (int) NameLength ((node)->name), NameText ((node)->name)
+
+enum BaseFormat
+{
+    TEXT_BASE,
+    BINARY_BASE
+};
+
+struct NameIndex
+{
+    Node** slots;
+    size_t capacity;
+    size_t size;
+};
+
+struct Tree
+{
+    Node* root;
+
+    arena nodes;
+    arena stats;
+
+    BaseFormat format;
+
+    NameIndex index;
+
+    NameSearch* search;    // nullptr until the first inexact lookup
+
+    Journal* journal;
+
+    size_t version;      // the number of splits since loading
+
+    size_t counted;      // stats events since the counters were last saved
 
-    char* name;
+    size_t snapshots;    // taken and not released yet
 };
 
-Node* CreateNode (Node* parent, Way mode);
-void  TreeDtor   (Node* node);
-void  TreeDump   (Node* node);
-void  PrintTree  (Node* node, FILE* file, int level);
+// A snapshot is the tree as it was at some version. SplitLeaf is the only change a
+// tree ever gets after loading and it stamps the leaf with the new version, so a
+// snapshot copies nothing: a reader just sees the leaves split after it as leaves.
+// It is taken by the thread that changes the tree and can be read on any other one
+// while the tree keeps learning. The nodes are not moved or freed while it is held.
+struct Snapshot
+{
+    Tree*  tree;
+    Node*  root;
+    size_t version;
+    size_t size;       // of the nodes arena, big trees are saved on several threads
+};
+
+// a node as a snapshot sees it
+struct NodeView
+{
+    Node*    right;
+    Node*    left;
+    uint32_t name;
+};
+
+void  TreeCtor    (Tree* tree);
+void  TreeDtor    (Tree* tree);
+bool  LoadTree    (Tree* tree, const char* base);
+bool  SaveTree    (Tree* tree, const char* base, BaseFormat format);
+Node* CreateNode  (Tree* tree, Node* parent, Way mode);
+Node* CreateNodeIn (arena* nodes, Node* parent, Way mode);
+void  SetNodeName (Tree* tree, Node* node, const char* name, size_t len);
+bool  SplitLeaf   (Tree* tree, Node* leaf, const char* object,   size_t object_len,
+                                         const char* question, size_t question_len);
+void  SetJump     (Node* node);
+Node* CommonAncestor (Node* node_1, Node* node_2, Node** child_1, Node** child_2);
+void  FindPath    (Node* node, PathStack* path);
+Node* NextPreOrder (Node* node, const Node* root, size_t max_depth, Way first);
+void  TreeDump    (Tree* tree, Node* node, size_t max_depth);
+void  ReapRenders ();
+void  PrintTree   (const Snapshot* snapshot, Node* node, FILE* file, int level);
+
+void     TakeSnapshot    (Tree* tree, Snapshot* snapshot);
+void     ReleaseSnapshot (Snapshot* snapshot);
+bool     SaveSnapshot    (const Snapshot* snapshot, const char* base, BaseFormat format);
+NodeView ViewNode        (const Snapshot* snapshot, const Node* node);
+Node*    NextPreOrderIn  (const Snapshot* snapshot, Node* node, const Node* root, size_t max_depth, Way first);
+
+void   IndexCtor    (NameIndex* index);
+void   IndexDtor    (NameIndex* index);
+bool   IndexInsert  (NameIndex* index, Node* leaf);
+Node*  IndexFind    (const NameIndex* index, const char* name, size_t len);
+Node*  IndexFindName (const NameIndex* index, uint32_t name);
+void   IndexReplace (NameIndex* index, Node* old_leaf, Node* new_leaf);
+size_t BuildIndex   (Tree* tree);
+uint64_t NameHash   (const char* name, size_t len);
+void   IndexReserve (NameIndex* index, size_t leaves);
+bool   IndexInsertShared (NameIndex* index, Node* leaf);
+
+bool  IsBinaryBase    (const char* buffer, size_t size);
+bool  GetTreeBinary   (Tree* tree, const char* buffer, size_t size);
+void  PrintTreeBinary (const Snapshot* snapshot, Node* node, FILE* file);
+
+bool  GetTreeText     (Tree* tree, const char* buffer, size_t size);
+void  PrintTreeText   (const Snapshot* snapshot, FILE* file);
+void  PrintTreeParallel (const Snapshot* snapshot, Node* node, FILE* file, size_t threads);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+const size_t ARENA_DEFAULT_SLAB = 64 * 1024;
+
+struct arena_slab
+{
+    arena_slab* next;
+    size_t      capacity;
+    size_t      used;
+};
+
+struct arena
+{
+    arena_slab* head;
+    size_t      slab_size;
+    size_t      allocated;
+};
+
+void  arena_ctor   (arena* ar, size_t slab_size);
+void* arena_alloc  (arena* ar, size_t size, size_t align);
+char* arena_strndup(arena* ar, const char* str, size_t len);
+void  arena_merge  (arena* dst, arena* src);
+void  arena_dtor   (arena* ar);
+
+#endif
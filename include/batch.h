@@ -0,0 +1,6 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+int RunBatch (const char* base, const char* commands);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Every name of every tree is kept once in a table shared by the whole program,
+// nodes hold its 32-bit id. Equal names get equal ids, so names are compared by
+// id. An id stays valid until the program exits.
+
+const uint32_t NAME_EMPTY = 0;             // "", the name of a fresh node
+const uint32_t NAME_NONE  = UINT32_MAX;    // returned by FindName for a name never interned
+
+struct InternStats
+{
+    size_t labels;          // names interned so far, equal ones counted every time
+    size_t label_bytes;
+    size_t strings;         // different names
+    size_t string_bytes;
+    size_t memory;          // taken by the table, text included
+};
+
+uint32_t    InternName     (const char* name, size_t len);
+uint32_t    FindName       (const char* name, size_t len);
+void        CountRepeats   (size_t labels, size_t label_bytes);
+const char* NameText       (uint32_t name);
+size_t      NameLength     (uint32_t name);
+void        GetInternStats (InternStats* stats);
+void        PrintInternStats (FILE* file);
+
+#endif
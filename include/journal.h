@@ -0,0 +1,52 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdio>
+
+#include <pthread.h>
+
+#include "akinator.h"
+
+// Append-only log of learned answers kept next to the base as <base>.journal.
+// Every SplitLeaf of a tree with an open journal is appended and synced to disk,
+// the base itself is only rewritten when the journal gets compacted. The file is
+// created by the first append, so a round that learns nothing leaves no journal.
+//
+// Once a record could not be written the journal takes no more of them: the
+// caller has to rewrite the whole base instead (JournalCompact does).
+//
+// SplitLeaf compacts the journal in the background: a snapshot of the tree is
+// saved over the base on a thread of its own while the tree keeps learning, and
+// then only the records that came after the snapshot are kept.
+
+const size_t JOURNAL_COMPACT_RECORDS = 1024;
+
+struct Journal
+{
+    FILE*  file;
+    char*  path;
+    const char* base;
+
+    size_t records;
+    bool   failed;            // a record was not written, the base has to be saved whole
+
+    // the compaction running in the background
+    pthread_t compactor;
+    bool      compacting;
+    bool      compacted;          // set by the compactor when it is done
+    bool      compact_saved;
+    Snapshot  snapshot;
+    long      compact_size;       // of the journal when the snapshot was taken
+    size_t    compact_records;
+};
+
+bool   JournalOpen    (Journal* journal, Tree* tree, const char* base);
+size_t JournalReplay  (Tree* tree, const char* base);
+bool   JournalAppend  (Journal* journal, Node* node);
+bool   JournalCompact (Journal* journal, Tree* tree);
+bool   JournalStartCompact  (Journal* journal, Tree* tree);
+bool   JournalFinishCompact (Journal* journal, bool wait);
+void   JournalClose   (Journal* journal);
+bool   JournalRemove  (const char* base);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+int RunOptimize (const char* base, const char* hits, const char* out);
+
+#endif
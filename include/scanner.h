@@ -0,0 +1,30 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Structural index of a text base, built 64 bytes at a time:
+// the positions of every '(', ')' and '\0' in order, plus two bitmaps
+// with one bit per input byte - any whitespace and whitespace other than ' '.
+// Large buffers are scanned by several threads.
+struct scan_index
+{
+    size_t*   marks;
+    size_t    size;
+    size_t    capacity;
+
+    uint64_t* blanks;  // isspace
+    uint64_t* breaks;  // isspace and not ' '
+    size_t    length;
+};
+
+bool        scan_build (scan_index* index, const char* buffer, size_t length, size_t threads);
+void        scan_dtor  (scan_index* index);
+const char* scan_kind  ();
+
+size_t scan_skip_blanks (const scan_index* index, size_t from, size_t to);
+size_t scan_trim_blanks (const scan_index* index, size_t from, size_t to);
+size_t scan_count_breaks(const scan_index* index, size_t from, size_t to);
+
+#endif
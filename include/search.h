@@ -0,0 +1,32 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "akinator.h"
+
+// Lookup of objects by a name that is not typed exactly. Names are compared
+// folded: Latin and Cyrillic letters in lower case, ё as е, runs of spaces as
+// one space. The index is built on the first lookup that needs it and then kept
+// up to date by SplitLeaf.
+//
+//   SearchPrefix   objects whose folded name starts with the folded prefix
+//   SearchSimilar  objects within a few edits of the name, closest first;
+//                  distance 0 means equal up to folding
+//   SearchSuggest  similar names first, then names with the prefix
+//   SearchFind     the exact index first, then the only name equal up to folding
+
+struct SearchMatch
+{
+    Node*  leaf;
+    size_t distance;
+};
+
+NameSearch* SearchBuild   (Tree* tree);
+void        SearchDtor    (NameSearch* search);
+void        SearchAdd     (NameSearch* search, uint32_t name);
+
+size_t SearchPrefix  (Tree* tree, const char* prefix, size_t len, Node** leaves, size_t max);
+size_t SearchSimilar (Tree* tree, const char* name, size_t len, SearchMatch* matches, size_t max);
+size_t SearchSuggest (Tree* tree, const char* name, size_t len, Node** leaves, size_t max);
+Node*  SearchFind    (Tree* tree, const char* name, size_t len);
+
+#endif
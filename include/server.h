@@ -0,0 +1,8 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+int RunServer (const char* base, const char* socket_path);
+int RunClient (const char* socket_path);
+int RunLoad   (const char* socket_path, int clients, int games);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "akinator.h"
+
+// One guessing game as a resumable state machine: SessionFeed takes one
+// line of user input at a time, so the same code drives the interactive
+// game and the sessions of the server.
+
+typedef void (*SayFunc) (void* context, const char* text);
+
+enum SessionState
+{
+    SESSION_QUESTION,
+    SESSION_GUESS,
+    SESSION_NEW_OBJECT,
+    SESSION_DIFFERENCE,
+    SESSION_OVER
+};
+
+struct Session
+{
+    Tree*        tree;
+    Node*        node;
+    SessionState state;
+
+    char*  new_object;
+    size_t new_object_len;
+
+    bool learned;
+
+    SayFunc say;
+    void*   context;
+};
+
+void SessionStart (Session* session, Tree* tree, SayFunc say, void* context);
+void SessionFeed  (Session* session, const char* line, size_t len);
+void SessionEnd   (Session* session);
+
+#endif
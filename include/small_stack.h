@@ -0,0 +1,219 @@
+#ifndef SMALL_STACK_H
+#define SMALL_STACK_H
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+// Header-only stack with the first InlineN elements stored inside the object
+// itself, so short stacks never touch the heap. It never shrinks.
+//
+// The canary, hash and verify checks of the old int stack are a compile-time
+// parameter: with Checked == false they are not compiled in at all and the
+// guard base class is empty.
+//
+// The elements are hashed incrementally: data_hash is the sum of a hash of every
+// element mixed with its position, so push and pop only add or subtract the slot
+// they touch. Every operation checks the canaries and the hash of the bookkeeping
+// fields, which covers data_hash. The elements themselves are rehashed by
+// verify_all, which runs before the buffer grows and in the destructor, and can be
+// called at any time.
+
+#ifdef _DEBUG
+    const bool STACK_CHECKED_BY_DEFAULT = true;
+#else
+    const bool STACK_CHECKED_BY_DEFAULT = false;
+#endif
+
+typedef unsigned long long stack_canary_t;
+const stack_canary_t STACK_CANARY = 0xDEADBABE;
+
+template <bool Checked>
+struct StackGuard
+{
+};
+
+template <>
+struct StackGuard<true>
+{
+    stack_canary_t left_canary;
+    unsigned long  hash;         // of the bookkeeping fields and data_hash
+    unsigned long  data_hash;    // sum of the slot hashes
+    stack_canary_t right_canary;
+};
+
+template <typename T, size_t InlineN, bool Checked = STACK_CHECKED_BY_DEFAULT>
+class Stack : private StackGuard<Checked>
+{
+    static_assert (std::is_trivially_copyable<T>::value, "Stack elements are copied with memcpy");
+    static_assert (InlineN > 0, "Stack needs some inline storage");
+
+public:
+    Stack () :
+        items    (inline_items),
+        count    (0),
+        capacity (InlineN)
+    {
+        if constexpr (Checked)
+        {
+            this->left_canary  = STACK_CANARY;
+            this->right_canary = STACK_CANARY;
+            this->data_hash    = 0;
+            this->hash         = calc_hash ();
+        }
+    }
+
+    ~Stack ()
+    {
+        verify_all ();
+
+        if (items != inline_items) free (items);
+    }
+
+    Stack            (const Stack&) = delete;
+    Stack& operator= (const Stack&) = delete;
+
+    void push (T value)
+    {
+        verify ();
+
+        if (count == capacity) grow ();
+        items[count] = value;
+
+        if constexpr (Checked) this->data_hash += slot_hash (count, value);
+
+        count++;
+        rehash ();
+    }
+
+    T pop ()
+    {
+        verify ();
+        assert (count > 0);
+
+        T value = items[--count];
+
+        if constexpr (Checked) this->data_hash -= slot_hash (count, value);
+
+        rehash ();
+
+        return value;
+    }
+
+    T& top ()
+    {
+        assert (count > 0);
+
+        return items[count - 1];
+    }
+
+    size_t size  () const { return count; }
+    bool   empty () const { return count == 0; }
+
+    void clear ()
+    {
+        count = 0;
+
+        if constexpr (Checked) this->data_hash = 0;
+
+        rehash ();
+    }
+
+    // rehashes every element, O(size)
+    void verify_all () const
+    {
+        verify ();
+
+        if constexpr (Checked)
+        {
+            unsigned long data_hash = 0;
+            for (size_t i = 0; i < count; i++) data_hash += slot_hash (i, items[i]);
+
+            if (data_hash != this->data_hash) corrupted ();
+        }
+    }
+
+private:
+    T*     items;
+    size_t count;
+    size_t capacity;
+    T      inline_items[InlineN];
+
+    void grow ()
+    {
+        // the old buffer is checked once before it is copied, amortized O(1) per push
+        verify_all ();
+
+        size_t new_capacity = 2 * capacity;
+
+        if (items == inline_items)
+        {
+            items = (T*) malloc (new_capacity * sizeof (T));
+            assert (items);
+            memcpy (items, inline_items, count * sizeof (T));
+        }
+        else
+        {
+            items = (T*) realloc (items, new_capacity * sizeof (T));
+            assert (items);
+        }
+
+        capacity = new_capacity;
+    }
+
+    // O(1): the canaries and the bookkeeping fields
+    void verify () const
+    {
+        if constexpr (Checked)
+        {
+            bool valid = this->left_canary  == STACK_CANARY &&
+                         this->right_canary == STACK_CANARY &&
+                         items != nullptr && count <= capacity &&
+                         this->hash == calc_hash ();
+            if (!valid) corrupted ();
+        }
+    }
+
+    void corrupted () const
+    {
+        fprintf (stderr, "Stack<%zu> at %p is corrupted\n", InlineN, (const void*) this);
+        abort ();
+    }
+
+    void rehash ()
+    {
+        if constexpr (Checked) this->hash = calc_hash ();
+    }
+
+    unsigned long calc_hash () const
+    {
+        return mix (count ^ (capacity << 16) ^ (unsigned long) items, this->data_hash);
+    }
+
+    // murmur-like hash of one element bound to its position, so that swapped
+    // elements do not cancel out in the sum
+    static unsigned long slot_hash (size_t index, const T& value)
+    {
+        unsigned long h = index * 0x9E3779B97F4A7C15UL;
+
+        const unsigned char* data = (const unsigned char*) &value;
+        for (size_t i = 0; i < sizeof (T); i++) h = mix (h, data[i]);
+
+        return h;
+    }
+
+    static unsigned long mix (unsigned long h, unsigned long value)
+    {
+        const unsigned long m = 0x5bd1e995;
+
+        h ^= value;
+        h *= m;
+        h ^= h >> 15;
+
+        return h;
+    }
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SPEECH_H
+#define SPEECH_H
+
+// Text to speech through one synthesizer process that lives as long as the game.
+// SpeechSay only puts the text into a queue, a writer thread feeds the queue to
+// the synthesizer, so the game goes on while the previous line is being spoken.
+//
+// The synthesizer is started without a shell and gets festival commands on stdin:
+//
+//   AKINATOR_TTS        the command, split on spaces
+//                       (festival --language russian --pipe by default)
+//   AKINATOR_TTS_CACHE  directory for synthesized lines (.tts_cache by default),
+//                       a line that is already there is played instead of synthesized
+//   AKINATOR_TTS_CACHE_SIZE
+//                       the most the cache may take, in MB (64 by default); the lines
+//                       played longest ago are deleted first
+
+bool SpeechStart ();
+void SpeechSay   (const char* text);
+void SpeechStop  ();
+
+#endif
@@ -16,7 +16,13 @@ const canary_t CANARY_CONST = 0xDEADBABE;
 
 #endif
 
-const int ERRORS_NUM = 7;
+#ifdef _HASH_PROTECTION
+
+const long long HASH_BLOCK = 16; // elements covered by one data hash
+
+#endif
+
+const int ERRORS_NUM = 12;
 
 enum stack_errors
 {
@@ -60,8 +66,9 @@ struct stack
     #endif
 
     #ifdef _HASH_PROTECTION
-        long unsigned int hash_struct;
-        long unsigned int hash_data;
+        long unsigned int  hash_struct;
+        long unsigned int  hash_data;   // combination of all block hashes
+        long unsigned int* hash_blocks; // one hash per HASH_BLOCK elements of data
     #endif
 
     elem_t* data;
@@ -94,6 +101,7 @@ stack_errors stack_ctor(stack* stk ON_DEBUG(, function_info func_info));
 stack_errors stack_push (stack* stk, elem_t value);
 stack_errors stack_pop(stack* stk, elem_t* popped_value);
 stack_errors stack_verify(stack* stk);
+stack_errors stack_verify_full(stack* stk);
 void stack_dtor (stack* stk);
 
 #ifdef _DEBUG
@@ -104,10 +112,21 @@ void stack_dtor (stack* stk);
 
 long unsigned int poltorashka_hash(const char* key, long unsigned int len);
 
+long unsigned int stack_hash_struct(stack* stk);
+long unsigned int stack_hash_block(const stack* stk, long long block);
+long unsigned int stack_mix_block(long long block, long unsigned int hash);
+long long         stack_blocks_num(long long capacity);
+
+void stack_rehash_all(stack* stk);
+void stack_rehash_slot(stack* stk, long long index);
+
+// rehashes the whole buffer, only after it has been (re)allocated
 #define HASH_PROTECTION_FUNCTION_CALL() \
-    stk->hash_struct = stk->hash_data = 0; \
-    stk->hash_struct = poltorashka_hash((const char*) stk, sizeof(stack)); \
-    stk->hash_data   = poltorashka_hash((const char*) stk->data, sizeof(elem_t) * stk->capacity); \
+    stack_rehash_all(stk);
+
+// rehashes the block holding the changed element and the struct, O(HASH_BLOCK)
+#define HASH_PROTECTION_SLOT_CALL(index) \
+    stack_rehash_slot(stk, index);
 
 #endif
 
@@ -0,0 +1,27 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "akinator.h"
+
+#include <ctime>
+
+// Per-node counters kept next to the base as <base>.stats, one line per node:
+// its path from the root as L/R letters and the counters in StatsEvent order.
+//
+// Counters are allocated on the first hit by the thread that plays the games and
+// bumped with relaxed atomics, so other threads can read them at any time.
+// A long session saves them every STATS_SAVE_PERIOD seconds, so a crash loses
+// only the games of the last period.
+
+const time_t STATS_SAVE_PERIOD = 60;
+
+void StatsCount     (Tree* tree, Node* node, StatsEvent event);
+void StatsCountGame (Tree* tree, Node* leaf, StatsEvent answer);
+void StatsCountPath (Tree* tree, Node* node, Node* stop);
+bool StatsLoad      (Tree* tree, const char* base);
+bool StatsSave      (Tree* tree, const char* base);
+bool StatsSaveDue   (Tree* tree, const char* base, time_t* saved_at);
+bool StatsRemove    (const char* base);
+int  RunStats       (const char* base);
+
+#endif
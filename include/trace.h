@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+
+// Timing of the phases of a round. Off unless one of the variables is set:
+//
+//   AKINATOR_TRACE=1              per-phase histograms go to stderr at exit
+//                                 and on SIGUSR1
+//   AKINATOR_TRACE_JSON=<file>    every timed call is also written to file
+//                                 as a Chrome trace event (chrome://tracing)
+//
+// A phase is timed with a pair of calls:
+//
+//   uint64_t start = TraceBegin ();
+//   ...
+//   TraceEnd (TRACE_PARSE, start);
+//
+// While tracing is off TraceBegin returns 0 and TraceEnd does nothing.
+
+enum TracePhase
+{
+    TRACE_READ,
+    TRACE_PARSE,
+    TRACE_LOOKUP,
+    TRACE_PATH,
+    TRACE_COMPARE,
+    TRACE_SERIALIZE,
+    TRACE_DUMP,
+    TRACE_DOT,
+    TRACE_SPEAK,
+    TRACE_PHASES
+};
+
+void     TraceInit  ();
+uint64_t TraceBegin ();
+void     TraceEnd   (TracePhase phase, uint64_t start);
+void     TraceSpan  (TracePhase phase, uint64_t start, uint64_t end);
+void     TracePoll  ();
+
+#endif
@@ -3,9 +3,12 @@
 
 #include <cstdio>
 
-char* get_file_content(const char* filename);
+char* get_file_content(const char* filename, size_t* size);
+char* map_file_content(const char* filename, size_t* size);
+void  unmap_file_content(char* data, size_t size);
+bool  is_special_file(const char* filename);
+bool  sync_parent_dir(const char* filename);
 int   calc_nlines(char* buffer);
-int   get_file_size(FILE* file);
 bool  is_equal(double a, double b);
 void  ClearBuffer ();
 
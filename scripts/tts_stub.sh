@@ -0,0 +1,19 @@
+#!/bin/sh
+# Stand-in for festival --pipe to try the speech pipeline without a synthesizer:
+# every command is logged, utt.save.wave writes an empty file, so the cache fills
+# up the same way it does with festival.
+#
+#   AKINATOR_TTS=scripts/tts_stub.sh AKINATOR_TTS_LOG=tts.log ./akinator base.txt
+
+log="${AKINATOR_TTS_LOG:-/dev/stderr}"
+
+while IFS= read -r line
+do
+    printf '%s\n' "$line" >> "$log"
+
+    wave=$(printf '%s\n' "$line" | sed -n "s/^(utt\.save\.wave akinator_utt \"\(.*\)\" 'riff)\$/\1/p")
+    if [ -n "$wave" ]
+    then
+        : > "$wave"
+    fi
+done
@@ -1,101 +1,173 @@
 #include "akinator.h"
-#include "stack.h"
+#include "batch.h"
+#include "journal.h"
+#include "optimizer.h"
+#include "search.h"
+#include "server.h"
+#include "session.h"
+#include "speech.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <cctype>
+#include <cstdarg>
 #include <cstring>
-
-static void   StartGame        (const char* base);
-static char*  GetTree          (Node* node, char* buffer);
-static void   Guess            (Node* node);
-static Node*  GetObject        (Node* node, const char* name);
-static void   GetSentence      (char* name);
-static void   FindPath         (Node* node, stack* stk);
-static void   TellAbout        (Node* node, stack* stk);
-static void   DescribeObject   (Node* main_node, const char* name);
-static void   CompareObjects   (Node* main_node, const char* name_1, const char* name_2);
-static void   PrintAndSpeak    (const char string[]);
-static void   AddNodeToBase    (Node* node);
+#include <cstdint>
+
+static int    PlayGame         (const char* base);
+static int    ConvertBase      (const char* from, const char* to, BaseFormat format);
+static void   StartGame        (Tree* tree);
+static void   Guess            (Tree* tree, Node* node);
+static void   ShowTree         (Tree* tree, const char* name, size_t len);
+static void   SuggestObjects   (Tree* tree, const char* name, size_t len);
+static bool   GetSentence      (char** line, size_t* capacity, size_t* len);
+static char*  GetWord          ();
+static void   TellAbout        (Node* node, PathStack* path);
+static void   DescribeObject   (Tree* tree, const char* name, size_t len);
+static void   CompareObjects   (Tree* tree, const char* name_1, size_t len_1,
+                                            const char* name_2, size_t len_2);
+static void   PrintAndSpeak    (const char* format, ...);
+static void   Speak            (void* context, const char* text);
 
 // #define SPEAK
 #ifdef SPEAK
-    #define PRINT_AND_SPEAK(...) do { \
-        char spoken_text[MAX_SPEAK_LENGTH] = ""; \
-        sprintf (spoken_text, __VA_ARGS__); \
-        PrintAndSpeak (spoken_text); } while (0)
+    #define PRINT_AND_SPEAK(...) PrintAndSpeak (__VA_ARGS__)
 #else
     #define PRINT_AND_SPEAK(...) printf (__VA_ARGS__)
 #endif
 
-const int MAX_SPEAK_LENGTH  = 1024;
-const int MAX_NAME_LENGTH   = 100;
-const int MAX_ANSWER_LENGTH = 7;
+const size_t DUMP_NEIGHBOURHOOD = 3;
+const size_t SUGGESTIONS_NUM    = 5;
 
 int main (int argc, const char** argv)
 {
-    if (argc != 2)
+    TraceInit ();
+
+    if (argc == 2) return PlayGame (argv[1]);
+
+    if ((argc == 3 || argc == 4) && strcmp (argv[1], "--batch") == 0)
+        return RunBatch (argv[2], (argc == 4) ? argv[3] : "-");
+
+    if (argc == 4 && strcmp (argv[1], "--server") == 0) return RunServer (argv[2], argv[3]);
+    if (argc == 3 && strcmp (argv[1], "--client") == 0) return RunClient (argv[2]);
+    if (argc == 5 && strcmp (argv[1], "--load")   == 0) return RunLoad (argv[2], atoi (argv[3]), atoi (argv[4]));
+
+    if (argc == 4 && strcmp (argv[1], "--to-binary") == 0) return ConvertBase (argv[2], argv[3], BINARY_BASE);
+    if (argc == 4 && strcmp (argv[1], "--to-text")   == 0) return ConvertBase (argv[2], argv[3], TEXT_BASE);
+
+    if (argc == 5 && strcmp (argv[1], "--optimize") == 0) return RunOptimize (argv[2], argv[3], argv[4]);
+    if (argc == 3 && strcmp (argv[1], "--stats")    == 0) return RunStats (argv[2]);
+
+    PRINT_AND_SPEAK ("Некорректный ввод аргументов командной строки\n");
+    return 1;
+}
+
+static int PlayGame (const char* base)
+{
+    assert (base);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, base))
     {
-        PRINT_AND_SPEAK ("Некорректный ввод аргументов командной строки\n");
+        fprintf (stderr, "Не удалось прочитать базу %s\n", base);
         return 1;
     }
 
-    char exit_mode[3] = "";
+    size_t replayed = JournalReplay (&tree, base);
+    StatsLoad (&tree, base);
+
+    PrintInternStats (stderr);
+
+    // without a journal the base is rewritten at exit, the way it always was
+    Journal journal = {};
+    JournalOpen (&journal, &tree, base);
+    bool journal_warned = false;
+
+#ifdef SPEAK
+    if (!SpeechStart ()) fprintf (stderr, "Не удалось запустить синтезатор речи, игра пойдет без звука\n");
+#endif
+
+    time_t stats_saved_at = time (nullptr);
+
     while (true)
     {
-        StartGame (argv[1]);
+        StartGame (&tree);
+        StatsSaveDue (&tree, base, &stats_saved_at);
+
+        if (journal.failed && !journal_warned)
+        {
+            fprintf (stderr, "Не удалось записать ответ в журнал базы %s, база будет сохранена целиком при выходе\n", base);
+            journal_warned = true;
+        }
 
         PRINT_AND_SPEAK ("Если вы хотите продолжить - введите п, "
                          "если вы хотите выйти - введите любую другую букву: \n");
-        scanf ("%s", exit_mode);
+        char* exit_mode = GetWord ();
+        TracePoll ();
+        ReapRenders ();
+
+        bool again = exit_mode && strcmp (exit_mode, "п") == 0;
+        free (exit_mode);
 
-        if (strcmp (exit_mode, "п") != 0) break;
+        if (!again) break;
     }
 
-    return 0;
-}
+#ifdef SPEAK
+    SpeechStop ();
+#endif
 
-Node* CreateNode (Node* parent, Way mode)
-{
-    assert (parent);
+    bool saved = true;
 
-    Node* node = (Node*) calloc (1, sizeof (Node));
-    assert (node);
+    if (journal.path)
+    {
+        if (replayed > 0 || journal.records > 0 || journal.failed) saved = JournalCompact (&journal, &tree);
+    }
+    else if (tree.version > 0)
+    {
+        saved = SaveTree (&tree, base, tree.format);
+    }
 
-    if (mode == LEFT)
-        parent->left  = node;
-    else
-        parent->right = node;
+    if (!saved) fprintf (stderr, "Не удалось сохранить базу %s\n", base);
+
+    JournalClose (&journal);
+
+    StatsSave (&tree, base);
 
-    node->parent = parent;
-    node->name  = (char*) calloc (MAX_NAME_LENGTH, sizeof (char));
+    TreeDtor (&tree);
 
-    return node;
+    return 0;
 }
 
-void TreeDtor (Node* node)
+// the input format is detected by LoadTree, the output one is given explicitly
+static int ConvertBase (const char* from, const char* to, BaseFormat format)
 {
-    if (node == nullptr) return;
+    assert (from);
+    assert (to);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, from))
+    {
+        fprintf (stderr, "Не удалось прочитать базу %s\n", from);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    JournalReplay (&tree, from);
 
-    free (node->name);
-    node->name = nullptr;
+    bool saved = SaveTree (&tree, to, format);
+    if (!saved) fprintf (stderr, "Не удалось записать базу %s\n", to);
 
-    TreeDtor (node->left);
-    free (node->left);
-    node->left = nullptr;
+    TreeDtor (&tree);
 
-    TreeDtor (node->right);
-    free (node->right);
-    node->right = nullptr;
+    return saved ? 0 : 1;
 }
 
-static void StartGame (const char* base)
+static void StartGame (Tree* tree)
 {
-    Node* main_node = (Node*) calloc (1, sizeof (Node));
-    main_node->name = (char*) calloc (MAX_NAME_LENGTH, sizeof (char));
+    assert (tree);
 
-    char* buffer = get_file_content (base);
-
-    GetTree (main_node, buffer + 1);
+    Node* main_node = tree->root;
 
     PRINT_AND_SPEAK ("Акинатор начинает разносить\n"
                     "Выбери режим: \n"
@@ -104,275 +176,229 @@ static void StartGame (const char* base)
                     "3) с - сравню 2 предмета из базы \n"
                     "4) п - выдать базу \n");
 
-    char mode[3] = "";
-    scanf ("%s", mode);
+    char* mode = GetWord ();
     ClearBuffer ();
 
-    if (strcmp (mode, "о") == 0)
+    char*  name_1 = nullptr, *name_2 = nullptr;
+    size_t capacity_1 = 0, capacity_2 = 0;
+    size_t len_1 = 0, len_2 = 0;
+
+    if (mode && strcmp (mode, "о") == 0)
     {
         PRINT_AND_SPEAK ("Если ответ на вопрос да - введите \"да\", если ответ нет - введите \"нет\"\n");
-        Guess (main_node);
+        Guess (tree, main_node);
     }
-    else if (strcmp (mode, "р") == 0)
+    else if (mode && strcmp (mode, "р") == 0)
     {
         PRINT_AND_SPEAK ("Введите название предмета: ");
-        char name[MAX_NAME_LENGTH] = "";
-        GetSentence (name);
+        GetSentence (&name_1, &capacity_1, &len_1);
 
-        DescribeObject (main_node, name);
+        DescribeObject (tree, name_1, len_1);
     }
-    else if (strcmp (mode, "с") == 0)
+    else if (mode && strcmp (mode, "с") == 0)
     {
         PRINT_AND_SPEAK ("Введите название первого предмета: ");
-        char name_1[MAX_NAME_LENGTH] = "";
-        GetSentence (name_1);
+        GetSentence (&name_1, &capacity_1, &len_1);
 
         PRINT_AND_SPEAK ("Введите название второго предмета: ");
-        char name_2[MAX_NAME_LENGTH] = "";
-        GetSentence (name_2);
+        GetSentence (&name_2, &capacity_2, &len_2);
 
-        if (strcmp (name_1, name_2) == 0) PRINT_AND_SPEAK ("Они одинаковые\n");
-        else CompareObjects (main_node, name_1, name_2);
+        if (len_1 == len_2 && memcmp (name_1, name_2, len_1) == 0) PRINT_AND_SPEAK ("Они одинаковые\n");
+        else CompareObjects (tree, name_1, len_1, name_2, len_2);
     }
-    else if (strcmp (mode, "п") == 0)
+    else if (mode && strcmp (mode, "п") == 0)
     {
-        system ("code tree.png");
+        PRINT_AND_SPEAK ("Введите название предмета, чтобы показать его окрестность, "
+                         "или пустую строку, чтобы показать всю базу: ");
+        GetSentence (&name_1, &capacity_1, &len_1);
+
+        ShowTree (tree, name_1, len_1);
     }
     else
     {
         PRINT_AND_SPEAK ("Неверный ввод режима\n");
     }
 
-    TreeDump (main_node);
-
-    FILE* file = fopen (base, "w");
-    PrintTree (main_node, file, 0);
-    fclose (file);
-
-    TreeDtor (main_node);
-    free (buffer);
+    free (name_1);
+    free (name_2);
+    free (mode);
 }
 
-static char* GetTree (Node* node, char* buffer)
+static void Guess (Tree* tree, Node* node)
 {
+    assert (tree);
     assert (node);
-    assert (buffer);
 
-    while (isspace (*buffer))
-    {
-        buffer++;
-    }
+    Session session = {};
+    SessionStart (&session, tree, Speak, nullptr);
 
-    if (*buffer == '(') buffer++;
+    char*  line     = nullptr;
+    size_t capacity = 0, len = 0;
 
-    for (int i = 0; *buffer != ')' && *buffer != '\0'; buffer++)
+    while (session.state != SESSION_OVER && GetSentence (&line, &capacity, &len))
     {
-        if (*buffer == '(')
-        {
-            buffer = GetTree (CreateNode (node, RIGHT), buffer + 1);
-            buffer = GetTree (CreateNode (node, LEFT ), buffer + 1);
-        }
-        else
-        {
-            if (isspace (*buffer) && *buffer != ' ') continue;
-            node->name[i++] = *buffer;
-        }
+        SessionFeed (&session, line, len);
     }
 
-    return buffer;
+    SessionEnd (&session);
+
+    free (line);
 }
 
-static void Guess (Node* node)
+// the whole tree for an empty name, otherwise the object with its closest questions
+static void ShowTree (Tree* tree, const char* name, size_t len)
 {
-    assert (node);
-
-    char answer[MAX_ANSWER_LENGTH] = "";
+    assert (tree);
+    assert (name);
 
-    while (! (node->left == nullptr && node->right == nullptr))
+    if (len == 0)
     {
-        PRINT_AND_SPEAK("%s?\n", node->name);
-        scanf ("%s", answer);
-
-        if (strcmp (answer, "да") == 0) node = node->left;
-        else if (strcmp (answer, "нет") == 0) node = node->right;
-        else
-        {
-            PRINT_AND_SPEAK ("Некорректный ввод! Попробуйте еще\n");
-            scanf ("%s", answer);
-        }
+        TreeDump (tree, tree->root, SIZE_MAX);
+        return;
     }
 
-    PRINT_AND_SPEAK ("Я знаю ответ! Это %s?\n", node->name);
+    Node* object = SearchFind (tree, name, len);
+    if (!object)
+    {
+        PRINT_AND_SPEAK ("Такого объекта в базе нет!\n");
+        SuggestObjects (tree, name, len);
+        return;
+    }
 
-    scanf ("%s", answer);
-    if (strcmp (answer, "да") == 0) PRINT_AND_SPEAK ("Ха я гений\n");
-    else
+    Node* node = object;
+    for (size_t i = 0; i < DUMP_NEIGHBOURHOOD && node->parent; i++)
     {
-        AddNodeToBase (node);
+        node = node->parent;
     }
+
+    TreeDump (tree, node, 2 * DUMP_NEIGHBOURHOOD);
 }
 
-static void AddNodeToBase (Node* node)
+static void Speak (void* context, const char* text)
 {
-    assert (node);
+    (void) context;
 
-    CreateNode (node, RIGHT);
-    CreateNode (node, LEFT);
-
-    PRINT_AND_SPEAK ("И кто же это?\n"
-                     "Это ");
-    ClearBuffer ();
-    GetSentence (node->left->name);
-
-    strcpy (node->right->name, node->name);
-
-    PRINT_AND_SPEAK ("А чем %s отличается от %s?\n"
-                     "Он(а/o) ", node->left->name, node->right->name);
-
-    GetSentence (node->name);
+    PRINT_AND_SPEAK ("%s", text);
 }
 
-static void CompareObjects (Node* main_node, const char* name_1, const char* name_2)
+static void CompareObjects (Tree* tree, const char* name_1, size_t len_1,
+                                        const char* name_2, size_t len_2)
 {
-    assert (main_node);
+    assert (tree);
     assert (name_1);
     assert (name_2);
 
-    Node* object_1 = GetObject (main_node, name_1);
+    Node* object_1 = SearchFind (tree, name_1, len_1);
     if (!object_1)
     {
         PRINT_AND_SPEAK ("Первого объекта в базе нет!\n");
+        SuggestObjects (tree, name_1, len_1);
         return;
     }
 
-    Node* object_2 = GetObject (main_node, name_2);
+    Node* object_2 = SearchFind (tree, name_2, len_2);
     if (!object_2)
     {
         PRINT_AND_SPEAK ("Второго объекта в базе нет!\n");
+        SuggestObjects (tree, name_2, len_2);
         return;
     }
 
-    stack stk_1 = {};
-    stack_ctor (&stk_1);
-    FindPath (object_1, &stk_1);
+    // the names differ only in case or spaces
+    if (object_1 == object_2)
+    {
+        PRINT_AND_SPEAK ("Они одинаковые\n");
+        return;
+    }
 
-    stack stk_2 = {};
-    stack_ctor (&stk_2);
-    FindPath (object_2, &stk_2);
+    Node* child_1 = nullptr;
+    Node* child_2 = nullptr;
+    Node* common  = CommonAncestor (object_1, object_2, &child_1, &child_2);
 
-    Node* node = main_node;
-    Way way_1 = LEFT;
-    Way way_2 = LEFT;
+    StatsCountPath (tree, object_1, nullptr);
+    StatsCountPath (tree, object_2, common);
 
-    while (stk_1.size > 0 && stk_2.size > 0)
-    {
-        stack_pop (&stk_1, (elem_t*) &way_1);
-        stack_pop (&stk_2, (elem_t*) &way_2);
+    PathStack path;
+    FindPath (common, &path);
 
-        if (way_1 != way_2)
-        {
-            if (way_1 == LEFT)
-            {
-                PRINT_AND_SPEAK("Про %s можно сказать %s, в то время как про %s так сказать нельзя\n",
-                                name_1, node->name, name_2);
-            }
-            else
-            {
-                PRINT_AND_SPEAK("Про %s можно сказать %s, в то время как про %s так сказать нельзя\n",
-                                name_2, node->name, name_1);
-            }
-
-            stack_dtor (&stk_1);
-            stack_dtor (&stk_2);
-
-            return;
-        }
+    Node* node = tree->root;
 
-        PRINT_AND_SPEAK("Про оба объекта можно сказать %s\n", node->name);
+    while (!path.empty ())
+    {
+        PRINT_AND_SPEAK("Про оба объекта можно сказать %.*s\n", NODE_NAME (node));
 
-        if (way_1 == LEFT) node = node->left;
+        if (path.pop () == LEFT) node = node->left;
         else node = node->right;
     }
 
-    stack_dtor (&stk_1);
-    stack_dtor (&stk_2);
+    if (child_1 == nullptr || child_2 == nullptr) return;
+
+    if (child_1 == common->left)
+    {
+        PRINT_AND_SPEAK("Про %.*s можно сказать %.*s, в то время как про %.*s так сказать нельзя\n",
+                        (int) len_1, name_1, NODE_NAME (common), (int) len_2, name_2);
+    }
+    else
+    {
+        PRINT_AND_SPEAK("Про %.*s можно сказать %.*s, в то время как про %.*s так сказать нельзя\n",
+                        (int) len_2, name_2, NODE_NAME (common), (int) len_1, name_1);
+    }
 }
 
-static Node* GetObject (Node* node, const char* name)
+static void SuggestObjects (Tree* tree, const char* name, size_t len)
 {
+    assert (tree);
     assert (name);
 
-    if (!node) return nullptr;
+    Node*  leaves[SUGGESTIONS_NUM] = {};
+    size_t found = SearchSuggest (tree, name, len, leaves, SUGGESTIONS_NUM);
 
-    if (strcmp (node->name, name) == 0) return node;
+    if (found == 0) return;
 
-    Node* object = GetObject (node->right, name);
-    if (object) return object;
+    PRINT_AND_SPEAK ("Может быть, вы имели в виду: ");
 
-    object = GetObject (node->left, name);
-    if (object) return object;
+    for (size_t i = 0; i < found; i++)
+    {
+        PRINT_AND_SPEAK ("%s%.*s", (i > 0) ? ", " : "", NODE_NAME (leaves[i]));
+    }
 
-    return nullptr;
+    PRINT_AND_SPEAK ("?\n");
 }
 
-static void DescribeObject (Node* main_node, const char* name)
+static void DescribeObject (Tree* tree, const char* name, size_t len)
 {
     assert (name);
-    assert (main_node);
+    assert (tree);
 
-    Node* object = GetObject (main_node, name);
+    Node* object = SearchFind (tree, name, len);
     if (!object)
     {
         PRINT_AND_SPEAK ("Такого объекта в базе нет!\n");
+        SuggestObjects (tree, name, len);
         return;
     }
 
-    stack stk = {};
-    stack_ctor (&stk);
-
-    FindPath (object, &stk);
-    TellAbout (main_node, &stk);
-    putchar ('\n');
-
-    stack_dtor (&stk);
-}
-
-static void FindPath (Node* node, stack* stk)
-{
-    assert (stk);
-
-    if (node->parent == nullptr) { return; }
+    StatsCountPath (tree, object, nullptr);
 
-    Node* parent = node->parent;
+    PathStack path;
 
-    if (node == parent->left)
-    {
-        stack_push (stk, LEFT);
-        FindPath (parent, stk);
-    }
-    else
-    {
-        stack_push (stk, RIGHT);
-        FindPath (parent, stk);
-    }
+    FindPath (object, &path);
+    TellAbout (tree->root, &path);
+    putchar ('\n');
 }
 
-static void TellAbout (Node* node, stack* stk)
+static void TellAbout (Node* node, PathStack* path)
 {
-    Way way = LEFT;
-
     while (node->left && node->right)
     {
-        stack_pop (stk, (int*) &way);
-
-        if (way == LEFT)
+        if (path->pop () == LEFT)
         {
-            PRINT_AND_SPEAK ("%s", node->name);
+            PRINT_AND_SPEAK ("%.*s", NODE_NAME (node));
             node = node->left;
         }
         else
         {
-            PRINT_AND_SPEAK ("не %s", node->name);
+            PRINT_AND_SPEAK ("не %.*s", NODE_NAME (node));
             node = node->right;
         }
 
@@ -384,28 +410,75 @@ static void TellAbout (Node* node, stack* stk)
 
 }
 
-static void PrintAndSpeak (const char string[])
+// formatted into a buffer of the text's own size, so a name of any length fits
+static void PrintAndSpeak (const char* format, ...)
 {
-    assert (string);
+    assert (format);
+
+    va_list args;
+
+    va_start (args, format);
+    int len = vsnprintf (nullptr, 0, format, args);
+    va_end (args);
+
+    if (len < 0) return;
+
+    char* text = (char*) calloc ((size_t) len + 1, sizeof (char));
+    assert (text);
 
-    printf ("%s", string);
+    va_start (args, format);
+    vsnprintf (text, (size_t) len + 1, format, args);
+    va_end (args);
 
-    char spoken_text[MAX_SPEAK_LENGTH] = "";
-    sprintf (spoken_text, "echo \"%s\" | festival --tts --language russian", string);
-    system (spoken_text);
+    fputs (text, stdout);
+
+    // the line is on the screen before it is heard
+    fflush (stdout);
+
+    SpeechSay (text);
+
+    free (text);
 }
 
-static void GetSentence (char* name)
+// Reads one line without its '\n' into a buffer that grows as needed. The line
+// is always null-terminated, even when nothing is left to read.
+// Returns false if the input has ended.
+static bool GetSentence (char** line, size_t* capacity, size_t* len)
 {
-    assert (name);
+    assert (line);
+    assert (capacity);
+    assert (len);
 
-    int ch = getchar (), i = 0;
+    ssize_t nread = getline (line, capacity, stdin);
 
-    while (ch != '\n')
+    if (nread < 0)
     {
-        name[i++] = ch;
-        ch = getchar ();
+        if (!*line)
+        {
+            *capacity = 1;
+            *line     = (char*) calloc (*capacity, sizeof (char));
+            assert (*line);
+        }
+
+        (*line)[0] = '\0';
+        *len       = 0;
+
+        return false;
     }
 
-    name[i] = '\0';
+    if (nread > 0 && (*line)[nread - 1] == '\n') (*line)[--nread] = '\0';
+
+    *len = (size_t) nread;
+
+    return true;
+}
+
+// the next word of any length, nullptr if the input has ended
+static char* GetWord ()
+{
+    char* word = nullptr;
+
+    if (scanf ("%ms", &word) != 1) return nullptr;
+
+    return word;
 }
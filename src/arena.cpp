@@ -0,0 +1,136 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "arena.h"
+
+static arena_slab* arena_new_slab(arena* ar, size_t min_size);
+
+static char* slab_data(arena_slab* slab)
+{
+    return (char*) slab + sizeof(arena_slab);
+}
+
+void arena_ctor(arena* ar, size_t slab_size)
+{
+    assert(ar);
+    assert(slab_size > 0);
+
+    ar->head      = nullptr;
+    ar->slab_size = slab_size;
+    ar->allocated = 0;
+}
+
+void* arena_alloc(arena* ar, size_t size, size_t align)
+{
+    assert(ar);
+    assert(align > 0 && (align & (align - 1)) == 0);
+
+    arena_slab* slab = ar->head;
+
+    if (slab != nullptr)
+    {
+        size_t offset = (slab->used + align - 1) & ~(align - 1);
+
+        if (offset + size <= slab->capacity)
+        {
+            slab->used = offset + size;
+            return slab_data(slab) + offset;
+        }
+    }
+
+    slab = arena_new_slab(ar, size + align);
+
+    size_t offset = (size_t) (-(uintptr_t) slab_data(slab)) & (align - 1);
+    slab->used = offset + size;
+
+    return slab_data(slab) + offset;
+}
+
+char* arena_strndup(arena* ar, const char* str, size_t len)
+{
+    assert(ar);
+    assert(str);
+
+    char* copy = (char*) arena_alloc(ar, len + 1, 1);
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    return copy;
+}
+
+// hands all slabs of src over to dst, the allocations stay where they are
+void arena_merge(arena* dst, arena* src)
+{
+    assert(dst);
+    assert(src);
+
+    if (src->head == nullptr) return;
+
+    arena_slab* tail = src->head;
+    while (tail->next != nullptr) tail = tail->next;
+
+    // dst keeps allocating from its current slab
+    if (dst->head == nullptr)
+    {
+        dst->head = src->head;
+    }
+    else
+    {
+        tail->next      = dst->head->next;
+        dst->head->next = src->head;
+    }
+
+    dst->allocated += src->allocated;
+
+    src->head      = nullptr;
+    src->allocated = 0;
+}
+
+void arena_dtor(arena* ar)
+{
+    assert(ar);
+
+    arena_slab* slab = ar->head;
+
+    while (slab != nullptr)
+    {
+        arena_slab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    ar->head      = nullptr;
+    ar->allocated = 0;
+}
+
+static arena_slab* arena_new_slab(arena* ar, size_t min_size)
+{
+    size_t capacity = ar->slab_size;
+    if (capacity < min_size) capacity = min_size;
+
+    arena_slab* slab = (arena_slab*) malloc(sizeof(arena_slab) + capacity);
+    assert(slab);
+
+    slab->capacity = capacity;
+    slab->used     = 0;
+
+    // an oversized slab goes behind the current one so that the
+    // remaining space of the current slab is not thrown away
+    if (capacity > ar->slab_size && ar->head != nullptr)
+    {
+        slab->next     = ar->head->next;
+        ar->head->next = slab;
+    }
+    else
+    {
+        slab->next = ar->head;
+        ar->head   = slab;
+    }
+
+    ar->allocated += sizeof(arena_slab) + capacity;
+
+    return slab;
+}
@@ -0,0 +1,325 @@
+#include "akinator.h"
+#include "batch.h"
+#include "journal.h"
+#include "search.h"
+
+#include <cstring>
+
+// Non-interactive mode: one command per line, one JSON object per line in reply.
+//
+//   describe <name>
+//   compare  <name 1> <name 2>
+//   guess    <да|нет> ...
+//
+// Arguments are separated by spaces, a name with spaces has to be put in
+// double quotes (\" and \\ escapes are supported). For describe the whole
+// rest of the line is the name, so quotes are optional there.
+//
+// A name is found the way the game finds it: as it is or, if only one object
+// fits, up to case and spaces. A name that is not in the base gets a list of
+// close names in the reply.
+
+const size_t BATCH_OUTPUT_BUFFER = 1 << 20;
+const size_t BATCH_SUGGESTIONS   = 5;
+
+struct BatchArg
+{
+    const char* str;
+    size_t      len;
+};
+
+static void  RunCommand      (Tree* tree, char* line, FILE* out);
+static void  BatchDescribe   (Tree* tree, char* args, FILE* out);
+static void  BatchCompare    (Tree* tree, char* args, FILE* out);
+static void  BatchGuess      (Tree* tree, char* args, FILE* out);
+static bool  NextArg         (char** args, BatchArg* arg);
+static char* SkipSpaces      (char* str);
+static void  PrintPath       (Node* node, size_t steps, PathStack* path, FILE* out);
+static void  PrintSuggestions (Tree* tree, const char* key, BatchArg* name, FILE* out);
+static void  PrintJsonString (const char* str, size_t len, FILE* out);
+
+int RunBatch (const char* base, const char* commands)
+{
+    assert (base);
+    assert (commands);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, base))
+    {
+        fprintf (stderr, "Не удалось прочитать базу %s\n", base);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    JournalReplay (&tree, base);
+
+    FILE* input = (strcmp (commands, "-") == 0) ? stdin : fopen (commands, "r");
+    if (!input)
+    {
+        fprintf (stderr, "Не удалось открыть файл команд %s\n", commands);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    static char output_buffer[BATCH_OUTPUT_BUFFER] = "";
+    setvbuf (stdout, output_buffer, _IOFBF, sizeof (output_buffer));
+
+    char*  line     = nullptr;
+    size_t capacity = 0;
+    ssize_t len     = 0;
+
+    while ((len = getline (&line, &capacity, input)) >= 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = '\0';
+        }
+
+        if (*SkipSpaces (line) != '\0') RunCommand (&tree, line, stdout);
+    }
+
+    fflush (stdout);
+
+    free (line);
+    if (input != stdin) fclose (input);
+
+    TreeDtor (&tree);
+
+    return 0;
+}
+
+static void RunCommand (Tree* tree, char* line, FILE* out)
+{
+    char* command = SkipSpaces (line);
+    char* args    = command + strcspn (command, " \t");
+
+    size_t command_len = (size_t) (args - command);
+
+    if      (command_len == 8 && strncmp (command, "describe", 8) == 0) BatchDescribe (tree, args, out);
+    else if (command_len == 7 && strncmp (command, "compare",  7) == 0) BatchCompare  (tree, args, out);
+    else if (command_len == 5 && strncmp (command, "guess",    5) == 0) BatchGuess    (tree, args, out);
+    else
+    {
+        fputs ("{\"error\":\"unknown command\",\"command\":", out);
+        PrintJsonString (command, command_len, out);
+        fputs ("}\n", out);
+    }
+}
+
+static void BatchDescribe (Tree* tree, char* args, FILE* out)
+{
+    BatchArg name = {};
+
+    args = SkipSpaces (args);
+    if (*args == '"')
+    {
+        NextArg (&args, &name);
+    }
+    else
+    {
+        name.str = args;
+        name.len = strlen (args);
+        while (name.len > 0 && (args[name.len - 1] == ' ' || args[name.len - 1] == '\t')) name.len--;
+    }
+
+    fputs ("{\"op\":\"describe\",\"name\":", out);
+    PrintJsonString (name.str, name.len, out);
+
+    Node* object = SearchFind (tree, name.str, name.len);
+    if (!object)
+    {
+        fputs (",\"found\":false", out);
+        PrintSuggestions (tree, "suggestions", &name, out);
+        fputs ("}\n", out);
+        return;
+    }
+
+    PathStack path;
+    FindPath (object, &path);
+
+    fputs (",\"found\":true,\"path\":", out);
+    PrintPath (tree->root, path.size (), &path, out);
+    fputs ("}\n", out);
+}
+
+static void BatchCompare (Tree* tree, char* args, FILE* out)
+{
+    BatchArg name_1 = {};
+    BatchArg name_2 = {};
+
+    if (!NextArg (&args, &name_1) || !NextArg (&args, &name_2))
+    {
+        fputs ("{\"op\":\"compare\",\"error\":\"two names expected\"}\n", out);
+        return;
+    }
+
+    fputs ("{\"op\":\"compare\",\"a\":", out);
+    PrintJsonString (name_1.str, name_1.len, out);
+    fputs (",\"b\":", out);
+    PrintJsonString (name_2.str, name_2.len, out);
+
+    Node* object_1 = SearchFind (tree, name_1.str, name_1.len);
+    Node* object_2 = SearchFind (tree, name_2.str, name_2.len);
+
+    if (!object_1 || !object_2)
+    {
+        fprintf (out, ",\"found\":false,\"found_a\":%s,\"found_b\":%s",
+                 object_1 ? "true" : "false", object_2 ? "true" : "false");
+
+        if (!object_1) PrintSuggestions (tree, "suggestions_a", &name_1, out);
+        if (!object_2) PrintSuggestions (tree, "suggestions_b", &name_2, out);
+
+        fputs ("}\n", out);
+        return;
+    }
+
+    fputs (",\"found\":true", out);
+
+    if (object_1 == object_2)
+    {
+        fputs (",\"same\":true}\n", out);
+        return;
+    }
+
+    Node* child_1 = nullptr;
+    Node* child_2 = nullptr;
+    Node* common  = CommonAncestor (object_1, object_2, &child_1, &child_2);
+
+    PathStack path;
+    FindPath (common, &path);
+
+    fputs (",\"same\":false,\"common\":", out);
+    PrintPath (tree->root, path.size (), &path, out);
+
+    fputs (",\"differ\":{\"question\":", out);
+    PrintJsonString (NameText (common->name), NameLength (common->name), out);
+    fprintf (out, ",\"a\":%s,\"b\":%s}}\n",
+             (child_1 == common->left) ? "true" : "false",
+             (child_2 == common->left) ? "true" : "false");
+}
+
+static void BatchGuess (Tree* tree, char* args, FILE* out)
+{
+    Node* node = tree->root;
+    BatchArg answer = {};
+    size_t asked = 0;
+
+    while (node->left && node->right && NextArg (&args, &answer))
+    {
+        if      (answer.len == strlen ("да")  && strncmp (answer.str, "да",  answer.len) == 0) node = node->left;
+        else if (answer.len == strlen ("нет") && strncmp (answer.str, "нет", answer.len) == 0) node = node->right;
+        else
+        {
+            fputs ("{\"op\":\"guess\",\"error\":\"bad answer\",\"answer\":", out);
+            PrintJsonString (answer.str, answer.len, out);
+            fputs ("}\n", out);
+            return;
+        }
+
+        asked++;
+    }
+
+    if (node->left && node->right)
+    {
+        fprintf (out, "{\"op\":\"guess\",\"asked\":%zu,\"question\":", asked);
+        PrintJsonString (NameText (node->name), NameLength (node->name), out);
+        fputs ("}\n", out);
+        return;
+    }
+
+    fprintf (out, "{\"op\":\"guess\",\"asked\":%zu,\"answer\":", asked);
+    PrintJsonString (NameText (node->name), NameLength (node->name), out);
+    fputs ("}\n", out);
+}
+
+// prints the first steps of the way on the stack as [{"question":...,"answer":...},...]
+static void PrintPath (Node* node, size_t steps, PathStack* path, FILE* out)
+{
+    fputc ('[', out);
+
+    for (size_t i = 0; i < steps; i++)
+    {
+        Way way = path->pop ();
+
+        fputs ((i == 0) ? "{\"question\":" : ",{\"question\":", out);
+        PrintJsonString (NameText (node->name), NameLength (node->name), out);
+        fprintf (out, ",\"answer\":%s}", (way == LEFT) ? "true" : "false");
+
+        node = (way == LEFT) ? node->left : node->right;
+    }
+
+    fputc (']', out);
+}
+
+static void PrintSuggestions (Tree* tree, const char* key, BatchArg* name, FILE* out)
+{
+    Node*  leaves[BATCH_SUGGESTIONS] = {};
+    size_t found = SearchSuggest (tree, name->str, name->len, leaves, BATCH_SUGGESTIONS);
+
+    fprintf (out, ",\"%s\":[", key);
+
+    for (size_t i = 0; i < found; i++)
+    {
+        if (i > 0) fputc (',', out);
+        PrintJsonString (NameText (leaves[i]->name), NameLength (leaves[i]->name), out);
+    }
+
+    fputc (']', out);
+}
+
+// arguments are modified in place: quotes and escapes are removed
+static bool NextArg (char** args, BatchArg* arg)
+{
+    char* str = SkipSpaces (*args);
+    if (*str == '\0') return false;
+
+    if (*str != '"')
+    {
+        arg->str = str;
+        arg->len = strcspn (str, " \t");
+        *args = str + arg->len;
+
+        return true;
+    }
+
+    char* read  = str + 1;
+    char* write = str + 1;
+
+    for (; *read != '\0' && *read != '"'; read++)
+    {
+        if (*read == '\\' && *(read + 1) != '\0') read++;
+        *write++ = *read;
+    }
+
+    arg->str = str + 1;
+    arg->len = (size_t) (write - str - 1);
+    *args = (*read == '"') ? read + 1 : read;
+
+    return true;
+}
+
+static char* SkipSpaces (char* str)
+{
+    while (*str == ' ' || *str == '\t') str++;
+
+    return str;
+}
+
+static void PrintJsonString (const char* str, size_t len, FILE* out)
+{
+    fputc ('"', out);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char ch = (unsigned char) str[i];
+
+        if      (ch == '"')  fputs ("\\\"", out);
+        else if (ch == '\\') fputs ("\\\\", out);
+        else if (ch == '\n') fputs ("\\n",  out);
+        else if (ch == '\t') fputs ("\\t",  out);
+        else if (ch <  0x20) fprintf (out, "\\u%04x", ch);
+        else                 fputc (ch, out);
+    }
+
+    fputc ('"', out);
+}
@@ -0,0 +1,315 @@
+#include "akinator.h"
+
+#include <cstdint>
+#include <cstring>
+
+// Binary base layout (native byte order):
+//
+//   BinaryHeader
+//   BinaryNode [node_count]   - pre-order, right child before left one like in the text base
+//   char       [strings_size] - names, not null-terminated
+//
+// The root always has index 0, so 0 in a child field means "no child".
+// Nodes with equal names share one string.
+
+const char     BINARY_MAGIC[8]  = {'A', 'K', 'I', 'N', 'B', 'A', 'S', 'E'};
+const uint32_t BINARY_VERSION   = 1;
+const uint32_t BINARY_NO_CHILD  = 0;
+const int      BINARY_ID_BITS   = 16;    // of the table of the names read last
+
+struct BinaryHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t node_count;
+    uint64_t strings_size;
+    uint64_t reserved;
+};
+
+struct BinaryNode
+{
+    uint64_t name_offset;
+    uint32_t name_len;
+    uint32_t right;
+    uint32_t left;
+    uint32_t reserved;
+};
+
+struct BinaryStrings
+{
+    uint32_t* names;      // NAME_EMPTY in an empty slot
+    uint64_t* offsets;
+    size_t    capacity;
+    uint64_t  size;       // of the strings block
+
+    uint32_t* order;      // the names in the order they are put into the block
+    size_t    count;
+};
+
+// The ids of the names read last by their offset, so a string that many nodes
+// share is not interned for every one of them. One slot per offset hash: a name
+// that lost its slot to another one is interned again when it comes back.
+struct BinaryIds
+{
+    uint64_t* offsets;
+    uint32_t* names;      // NAME_EMPTY in an empty slot
+
+    size_t    repeats;    // names found here instead of being interned again
+    size_t    repeat_bytes;
+};
+
+static bool     ReadNodes   (Node* nodes, const BinaryHeader* header, const char* table, const char* strings,
+                             BinaryIds* ids);
+static uint32_t ReadName    (BinaryIds* ids, const char* strings, uint64_t offset, uint32_t len);
+static uint64_t FlattenTree (const Snapshot* snapshot, Node* root, BinaryNode* table, BinaryStrings* strings);
+static uint64_t NameOffset  (BinaryStrings* strings, uint32_t name);
+static uint32_t CountNodes  (const Snapshot* snapshot, Node* node);
+static void     WriteNames  (const BinaryStrings* strings, FILE* file);
+
+bool IsBinaryBase (const char* buffer, size_t size)
+{
+    assert (buffer);
+
+    return size >= sizeof (BinaryHeader) && memcmp (buffer, BINARY_MAGIC, sizeof (BINARY_MAGIC)) == 0;
+}
+
+// the node table is read in one pass without any tokenizing
+bool GetTreeBinary (Tree* tree, const char* buffer, size_t size)
+{
+    assert (tree);
+    assert (buffer);
+
+    BinaryHeader header = {};
+    memcpy (&header, buffer, sizeof (header));
+
+    if (header.version != BINARY_VERSION || header.node_count == 0) return false;
+
+    size_t table_size = (size_t) header.node_count * sizeof (BinaryNode);
+    if (size < sizeof (header) + table_size ||
+        size - sizeof (header) - table_size < header.strings_size) return false;
+
+    const char* table   = buffer + sizeof (header);
+    const char* strings = table + table_size;
+
+    Node* nodes = (Node*) arena_alloc (&tree->nodes, header.node_count * sizeof (Node), alignof (Node));
+    memset (nodes, 0, header.node_count * sizeof (Node));
+    SetJump (&nodes[0]);
+
+    BinaryIds ids = {};
+    ids.offsets = (uint64_t*) calloc ((size_t) 1 << BINARY_ID_BITS, sizeof (uint64_t));
+    ids.names   = (uint32_t*) calloc ((size_t) 1 << BINARY_ID_BITS, sizeof (uint32_t));
+    assert (ids.offsets);
+    assert (ids.names);
+
+    bool read = ReadNodes (nodes, &header, table, strings, &ids);
+
+    CountRepeats (ids.repeats, ids.repeat_bytes);
+
+    free (ids.offsets);
+    free (ids.names);
+
+    if (!read) return false;
+
+    tree->root = nodes;
+
+    return true;
+}
+
+static bool ReadNodes (Node* nodes, const BinaryHeader* header, const char* table, const char* strings,
+                       BinaryIds* ids)
+{
+    for (uint32_t i = 0; i < header->node_count; i++)
+    {
+        BinaryNode entry = {};
+        memcpy (&entry, table + i * sizeof (BinaryNode), sizeof (entry));
+
+        if (entry.name_offset > header->strings_size ||
+            entry.name_len    > header->strings_size - entry.name_offset) return false;
+
+        if ((entry.right == BINARY_NO_CHILD) != (entry.left == BINARY_NO_CHILD)) return false;
+
+        Node* node = &nodes[i];
+
+        // every child comes after its parent, so a node nobody has linked yet is an orphan
+        if (i > 0 && node->parent == nullptr) return false;
+
+        node->name = ReadName (ids, strings, entry.name_offset, entry.name_len);
+
+        if (entry.right != BINARY_NO_CHILD)
+        {
+            if (entry.right <= i || entry.right >= header->node_count ||
+                nodes[entry.right].parent != nullptr) return false;
+
+            nodes[entry.right].parent = node;
+            nodes[entry.right].depth  = node->depth + 1;
+            SetJump (&nodes[entry.right]);
+            node->right               = &nodes[entry.right];
+        }
+
+        if (entry.left != BINARY_NO_CHILD)
+        {
+            if (entry.left <= i || entry.left >= header->node_count ||
+                nodes[entry.left].parent != nullptr) return false;
+
+            nodes[entry.left].parent = node;
+            nodes[entry.left].depth  = node->depth + 1;
+            SetJump (&nodes[entry.left]);
+            node->left               = &nodes[entry.left];
+        }
+    }
+
+    return true;
+}
+
+// Nodes with equal names share an offset, so a name seen before is mostly found
+// by its offset without hashing its text. Files where every node has a string of
+// its own still load, each name is interned as before.
+static uint32_t ReadName (BinaryIds* ids, const char* strings, uint64_t offset, uint32_t len)
+{
+    if (len == 0) return NAME_EMPTY;
+
+    size_t pos = (size_t) ((offset * 0x9e3779b97f4a7c15) >> (64 - BINARY_ID_BITS));
+
+    // another length at the same offset is another name
+    if (ids->names[pos] != NAME_EMPTY && ids->offsets[pos] == offset && NameLength (ids->names[pos]) == len)
+    {
+        ids->repeats++;
+        ids->repeat_bytes += len;
+
+        return ids->names[pos];
+    }
+
+    ids->offsets[pos] = offset;
+    ids->names[pos]   = InternName (strings + offset, len);
+
+    return ids->names[pos];
+}
+
+void PrintTreeBinary (const Snapshot* snapshot, Node* node, FILE* file)
+{
+    assert (snapshot);
+    assert (node);
+    assert (file);
+
+    uint32_t node_count = CountNodes (snapshot, node);
+
+    BinaryNode* table = (BinaryNode*) calloc (node_count, sizeof (BinaryNode));
+    assert (table);
+
+    // twice as many slots as nodes, the table of offsets never grows
+    BinaryStrings strings = {};
+    strings.capacity = 2;
+    while (strings.capacity < 2 * (size_t) node_count) strings.capacity *= 2;
+
+    strings.names   = (uint32_t*) calloc (strings.capacity, sizeof (uint32_t));
+    strings.offsets = (uint64_t*) calloc (strings.capacity, sizeof (uint64_t));
+    strings.order   = (uint32_t*) calloc (node_count, sizeof (uint32_t));
+    assert (strings.names);
+    assert (strings.offsets);
+    assert (strings.order);
+
+    uint64_t strings_size = FlattenTree (snapshot, node, table, &strings);
+
+    BinaryHeader header = {};
+    memcpy (header.magic, BINARY_MAGIC, sizeof (BINARY_MAGIC));
+    header.version      = BINARY_VERSION;
+    header.node_count   = node_count;
+    header.strings_size = strings_size;
+
+    fwrite (&header, sizeof (header),     1,          file);
+    fwrite (table,   sizeof (BinaryNode), node_count, file);
+
+    WriteNames (&strings, file);
+
+    free (strings.names);
+    free (strings.offsets);
+    free (strings.order);
+    free (table);
+}
+
+// Pre-order numbering without recursion: the parent of a node is the last
+// node numbered one level above it, so only one index per level is kept.
+static uint64_t FlattenTree (const Snapshot* snapshot, Node* root, BinaryNode* table, BinaryStrings* strings)
+{
+    size_t    capacity = 64;
+    uint32_t* opened   = (uint32_t*) calloc (capacity, sizeof (uint32_t));
+    assert (opened);
+
+    uint32_t index = 0;
+
+    for (Node* node = root; node; node = NextPreOrderIn (snapshot, node, root, SIZE_MAX, RIGHT), index++)
+    {
+        size_t level = node->depth - root->depth;
+
+        if (level >= capacity)
+        {
+            capacity *= 2;
+            opened = (uint32_t*) realloc (opened, capacity * sizeof (uint32_t));
+            assert (opened);
+        }
+
+        opened[level] = index;
+
+        uint32_t name = ViewNode (snapshot, node).name;
+
+        table[index].name_offset = NameOffset (strings, name);
+        table[index].name_len    = (uint32_t) NameLength (name);
+
+        if (node == root) continue;
+
+        BinaryNode* parent = &table[opened[level - 1]];
+
+        if (node == node->parent->right)
+            parent->right = index;
+        else
+            parent->left  = index;
+    }
+
+    free (opened);
+
+    return strings->size;
+}
+
+// the offset of the name in the strings block, a new name is put at its end
+static uint64_t NameOffset (BinaryStrings* strings, uint32_t name)
+{
+    if (name == NAME_EMPTY) return 0;
+
+    size_t mask = strings->capacity - 1;
+    size_t pos  = (size_t) (((uint64_t) name * 0x9e3779b97f4a7c15) >> 32) & mask;
+
+    while (strings->names[pos] != NAME_EMPTY)
+    {
+        if (strings->names[pos] == name) return strings->offsets[pos];
+
+        pos = (pos + 1) & mask;
+    }
+
+    strings->names[pos]   = name;
+    strings->offsets[pos] = strings->size;
+    strings->size        += NameLength (name);
+
+    strings->order[strings->count++] = name;
+
+    return strings->offsets[pos];
+}
+
+static uint32_t CountNodes (const Snapshot* snapshot, Node* root)
+{
+    uint32_t count = 0;
+
+    for (Node* node = root; node; node = NextPreOrderIn (snapshot, node, root, SIZE_MAX, RIGHT))
+    {
+        count++;
+    }
+
+    return count;
+}
+
+static void WriteNames (const BinaryStrings* strings, FILE* file)
+{
+    for (size_t i = 0; i < strings->count; i++)
+    {
+        fwrite (NameText (strings->order[i]), sizeof (char), NameLength (strings->order[i]), file);
+    }
+}
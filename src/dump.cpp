@@ -1,18 +1,71 @@
 #include "akinator.h"
+#include "trace.h"
 
-static void NodeDump        (FILE* dot, Node* node);
-static void DrawConnections (FILE* dot, Node* node);
-static void PrintTabs       (FILE* file, int level);
+#include <csignal>
 
-const char* const dot_file = "dump.dot";
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// a render timed by the render process itself, the parent only learns when it is reaped
+struct RenderSpan
+{
+    pid_t    pid;
+    uint64_t start;
+    uint64_t end;
+};
+
+static void NodeDump        (FILE* dot, const Snapshot* snapshot, Node* node, size_t max_depth);
+static void DrawConnections (FILE* dot, const Snapshot* snapshot, Node* node, size_t max_depth);
+static void RenderDump      (bool rerender);
+static int  RunCommand      (const char* command);
+static void RenderFile      (pid_t pid, char* file, size_t size);
+static RenderSpan* StartRender ();
+static void EndRender       (pid_t pid);
+
+const char* const dot_file     = "dump.dot";
+const char* const dot_tmp_file = "dump.dot.tmp";
+const char* const png_file     = "tree.png";
+
+const char* const show_command = "code tree.png";
+
+const size_t RENDER_SLOTS     = 8;
+const size_t RENDER_FILE_SIZE = 64;
+
+// shared with the render processes, mapped when the first render is timed
+static RenderSpan* render_spans = nullptr;
+
+// the render processes that have not been reaped yet, 0 in a free slot
+static pid_t renders[RENDER_SLOTS] = {};
+
+// the last dump, it is not rendered again while the tree stays the same
+static Node*  dumped_node    = nullptr;
+static size_t dumped_depth   = 0;
+static size_t dumped_version = 0;
 
 #define _print(...) fprintf (dot, __VA_ARGS__)
 
-void TreeDump (Node* node)
+// Dumps the subtree of the node down to max_depth levels below it and shows the
+// picture. Graphviz runs in a background process, so the game is not blocked.
+// The dump is made from a snapshot, so it may be made on a thread of its own as well.
+void TreeDump (Tree* tree, Node* node, size_t max_depth)
 {
+    assert (tree);
     assert (node);
 
-    FILE* dot = fopen (dot_file, "w");
+    if (node == dumped_node && max_depth == dumped_depth && tree->version == dumped_version)
+    {
+        RenderDump (false);
+        return;
+    }
+
+    uint64_t start = TraceBegin ();
+
+    FILE* dot = fopen (dot_tmp_file, "w");
+    if (!dot) return;
+
+    Snapshot snapshot = {};
+    TakeSnapshot (tree, &snapshot);
 
     _print (R"(
             digraph g {
@@ -20,66 +73,198 @@ void TreeDump (Node* node)
             graph[ranksep = 1.3, nodesep = 0.5, style = "rounded, filled"]
             )");
 
-    NodeDump (dot, node);
+    NodeDump (dot, &snapshot, node, max_depth);
 
-    DrawConnections (dot, node);
+    DrawConnections (dot, &snapshot, node, max_depth);
 
     _print ("}\n");
 
     fclose (dot);
 
-    system ("dot -Tpng dump.dot -o tree.png");
+    size_t version = snapshot.version;
+    ReleaseSnapshot (&snapshot);
+
+    // a render that is still running keeps reading the old file
+    if (rename (dot_tmp_file, dot_file) != 0) return;
+
+    TraceEnd (TRACE_DUMP, start);
+
+    dumped_node    = node;
+    dumped_depth   = max_depth;
+    dumped_version = version;
+
+    RenderDump (true);
 }
 
-void NodeDump (FILE* dot, Node* node)
+// Reaps the renders that have finished, and only them: the speech synthesizer and
+// the other children are waited for by their own code. Is called before every
+// render and on every pass of the game loop, so a finished render does not stay
+// a zombie until the next dump.
+void ReapRenders ()
 {
-    if (node == nullptr) return;
+    for (size_t i = 0; i < RENDER_SLOTS; i++)
+    {
+        if (renders[i] == 0 || waitpid (renders[i], nullptr, WNOHANG) != renders[i]) continue;
 
-    _print ("Node%p[shape=rectangle, color=\"red\", width=0.2, style=\"filled\","
-            "fillcolor=\"lightblue\", label=\"%s\"] \n \n",
-            node, node->name);
+        EndRender (renders[i]);
 
-    NodeDump (dot, node->left);
-    NodeDump (dot, node->right);
+        // a render that was stopped leaves its picture behind
+        char file[RENDER_FILE_SIZE] = "";
+        RenderFile (renders[i], file, sizeof (file));
+        remove (file);
+
+        renders[i] = 0;
+    }
 }
 
-static void DrawConnections (FILE* dot, Node* node)
+// Every render draws into a file of its own and renames it over tree.png when it
+// is done, so the picture is never half written. A new picture of the tree stops
+// the renders of the old ones, so an old render can not finish last and put its
+// picture over the new one. A render runs in a process group of its own, which is
+// stopped together with dot.
+static void RenderDump (bool rerender)
 {
-    if (node->left)
+    ReapRenders ();
+
+    if (rerender)
+    {
+        for (size_t i = 0; i < RENDER_SLOTS; i++)
+        {
+            if (renders[i] != 0) kill (-renders[i], SIGTERM);
+        }
+    }
+
+    size_t slot = 0;
+    while (slot < RENDER_SLOTS && renders[slot] != 0) slot++;
+
+    // too many stopped renders are still exiting, the picture stays as it is
+    if (slot == RENDER_SLOTS) return;
+
+    RenderSpan* span = rerender ? StartRender () : nullptr;
+
+    pid_t pid = fork ();
+    if (pid == 0)
     {
-        _print ("Node%p->Node%p\n", node, node->left);
-        DrawConnections (dot, node->left);
+        setpgid (0, 0);
+
+        if (rerender)
+        {
+            char file[RENDER_FILE_SIZE] = "";
+            RenderFile (getpid (), file, sizeof (file));
+
+            char command[2 * RENDER_FILE_SIZE] = "";
+            snprintf (command, sizeof (command), "dot -Tpng %s -o %s", dot_file, file);
+
+            int status = RunCommand (command);
+            if (span) __atomic_store_n (&span->end, TraceBegin (), __ATOMIC_RELEASE);
+
+            if (status != 0 || rename (file, png_file) != 0)
+            {
+                remove (file);
+                _exit (1);
+            }
+        }
+
+        execlp ("sh", "sh", "-c", show_command, (char*) nullptr);
+        _exit (127);
     }
 
-    if (node->right)
+    if (pid > 0)
     {
-        _print ("Node%p->Node%p\n", node, node->right);
-        DrawConnections (dot, node->right);
+        // set by both processes, so it is there before either of them goes on
+        setpgid (pid, pid);
+        renders[slot] = pid;
     }
+
+    if (span)
+    {
+        if (pid > 0) span->pid   = pid;
+        else         span->start = 0;
+    }
+}
+
+static void RenderFile (pid_t pid, char* file, size_t size)
+{
+    snprintf (file, size, "%s.%d.tmp", png_file, (int) pid);
 }
 
-#define $print(...) fprintf (file, __VA_ARGS__)
+static int RunCommand (const char* command)
+{
+    pid_t pid = fork ();
+    if (pid == 0)
+    {
+        execlp ("sh", "sh", "-c", command, (char*) nullptr);
+        _exit (127);
+    }
+
+    int status = 0;
+    if (pid < 0 || waitpid (pid, &status, 0) != pid) return -1;
+
+    return status;
+}
 
-void PrintTree (Node* node, FILE* file, int level)
+// nullptr if tracing is off or too many renders are running
+static RenderSpan* StartRender ()
 {
-    assert (file);
+    uint64_t start = TraceBegin ();
+    if (start == 0) return nullptr;
+
+    if (!render_spans)
+    {
+        void* spans = mmap (nullptr, RENDER_SLOTS * sizeof (RenderSpan), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (spans == MAP_FAILED) return nullptr;
+
+        render_spans = (RenderSpan*) spans;
+    }
 
-    PrintTabs (file, level);
-    $print ("(\n");
+    for (size_t i = 0; i < RENDER_SLOTS; i++)
+    {
+        if (render_spans[i].start != 0) continue;
+
+        render_spans[i] = {0, start, 0};
+        return &render_spans[i];
+    }
+
+    return nullptr;
+}
+
+static void EndRender (pid_t pid)
+{
+    if (!render_spans) return;
 
-    PrintTabs (file, level);
-    $print("%s\n", node->name);
+    for (size_t i = 0; i < RENDER_SLOTS; i++)
+    {
+        RenderSpan* span = &render_spans[i];
+        if (span->start == 0 || span->pid != pid) continue;
 
-    if (node->right) PrintTree (node->right, file, level + 1);
-    if (node->left ) PrintTree (node->left,  file, level + 1);
+        // a render stopped before dot has finished has nothing to report
+        uint64_t end = __atomic_load_n (&span->end, __ATOMIC_ACQUIRE);
+        if (end != 0) TraceSpan (TRACE_DOT, span->start, end);
 
-    PrintTabs (file, level);
-    $print (")\n");
+        *span = {};
+        return;
+    }
 }
 
-static void PrintTabs (FILE* file, int level)
+static void NodeDump (FILE* dot, const Snapshot* snapshot, Node* node, size_t max_depth)
 {
-    assert (file);
+    for (Node* cur = node; cur; cur = NextPreOrderIn (snapshot, cur, node, max_depth, LEFT))
+    {
+        uint32_t name = ViewNode (snapshot, cur).name;
+
+        _print ("Node%p[shape=rectangle, color=\"red\", width=0.2, style=\"filled\","
+                "fillcolor=\"lightblue\", label=\"%.*s\"] \n \n",
+                cur, (int) NameLength (name), NameText (name));
+    }
+}
 
-    for (int i = 0; i < level; i++) $print ("\t");
+// every edge is printed when the walk enters its child
+static void DrawConnections (FILE* dot, const Snapshot* snapshot, Node* node, size_t max_depth)
+{
+    for (Node* cur = NextPreOrderIn (snapshot, node, node, max_depth, LEFT); cur;
+               cur = NextPreOrderIn (snapshot, cur,  node, max_depth, LEFT))
+    {
+        _print ("Node%p->Node%p\n", cur->parent, cur);
+    }
 }
@@ -0,0 +1,339 @@
+#include "akinator.h"
+#include "intern.h"
+
+#include <cstring>
+#include <mutex>
+
+// The table is split into shards by the high bits of the name hash, each with a
+// lock of its own, so the loader threads seldom wait for each other. The low bits
+// of an id are the shard, the rest is the place of the name in the shard plus one,
+// so only "" gets id 0.
+//
+// The entries of a shard are kept in chunks that double in size and never move,
+// so a name is read without the lock: whoever holds an id got it after the entry
+// had been written.
+
+const int      INTERN_SHARD_BITS = 6;
+const size_t   INTERN_SHARDS     = 1 << INTERN_SHARD_BITS;
+const int      INTERN_PLACE_BITS = 32 - INTERN_SHARD_BITS;
+const uint32_t INTERN_PLACE_MASK = ((uint32_t) 1 << INTERN_PLACE_BITS) - 1;
+const size_t   INTERN_MAX_PLACE  = INTERN_PLACE_MASK - 1;
+const int      INTERN_CHUNK_BITS = 4;     // the first chunk has 16 entries
+const size_t   INTERN_CHUNKS     = INTERN_PLACE_BITS - INTERN_CHUNK_BITS;
+const int      INTERN_TAG_SHIFT  = 32;    // the low half of the hash chooses the slot
+const size_t   INTERN_MIN_SLOTS  = 64;
+const size_t   INTERN_MIN_SLAB   = 1024;
+const size_t   INTERN_MAX_SLAB   = 256 * 1024;
+
+struct InternEntry
+{
+    const char* text;    // null-terminated
+    uint32_t    len;
+    uint32_t    hash;    // the low half of TextHash
+};
+
+struct InternShard
+{
+    std::mutex lock;
+
+    InternEntry* chunks[INTERN_CHUNKS];
+    size_t       size;
+
+    // place + 1 of an entry with a few more bits of the hash above it, 0 in an
+    // empty slot, so a probe seldom looks at an entry of another name
+    uint32_t* slots;
+    size_t    capacity;
+
+    arena text;
+
+    size_t labels;
+    size_t label_bytes;
+    size_t string_bytes;
+};
+
+static InternShard intern_shards[INTERN_SHARDS];
+
+static InternEntry* EntryAt   (const InternShard* shard, size_t place);
+static uint32_t*    FindSlot  (const InternShard* shard, const char* name, size_t len, uint64_t hash);
+static uint32_t     SlotTag   (uint64_t hash);
+static uint32_t     AddEntry  (InternShard* shard, const char* name, size_t len, uint64_t hash);
+static void         ShardGrow (InternShard* shard);
+static size_t       ShardOf   (uint64_t hash);
+static uint64_t     TextHash  (const char* name, size_t len);
+static void         PrintSize (FILE* file, size_t bytes);
+
+uint32_t InternName (const char* name, size_t len)
+{
+    assert (name);
+
+    if (len == 0) return NAME_EMPTY;
+
+    uint64_t     hash  = TextHash (name, len);
+    size_t       index = ShardOf (hash);
+    InternShard* shard = &intern_shards[index];
+
+    shard->lock.lock ();
+
+    shard->labels++;
+    shard->label_bytes += len;
+
+    if (4 * (shard->size + 1) > 3 * shard->capacity) ShardGrow (shard);
+
+    uint32_t* slot = FindSlot (shard, name, len, hash);
+    if (*slot == 0) *slot = SlotTag (hash) | AddEntry (shard, name, len, hash);
+
+    uint32_t id = ((*slot & INTERN_PLACE_MASK) << INTERN_SHARD_BITS) | (uint32_t) index;
+
+    shard->lock.unlock ();
+
+    return id;
+}
+
+// the id of a name without adding it to the table
+uint32_t FindName (const char* name, size_t len)
+{
+    assert (name);
+
+    if (len == 0) return NAME_EMPTY;
+
+    uint64_t     hash  = TextHash (name, len);
+    size_t       index = ShardOf (hash);
+    InternShard* shard = &intern_shards[index];
+
+    shard->lock.lock ();
+
+    uint32_t id = NAME_NONE;
+
+    if (shard->capacity > 0)
+    {
+        uint32_t place = *FindSlot (shard, name, len, hash) & INTERN_PLACE_MASK;
+        if (place != 0) id = (place << INTERN_SHARD_BITS) | (uint32_t) index;
+    }
+
+    shard->lock.unlock ();
+
+    return id;
+}
+
+// counts names that a loader did not intern again because it already had their id
+void CountRepeats (size_t labels, size_t label_bytes)
+{
+    InternShard* shard = &intern_shards[0];
+
+    shard->lock.lock ();
+
+    shard->labels      += labels;
+    shard->label_bytes += label_bytes;
+
+    shard->lock.unlock ();
+}
+
+const char* NameText (uint32_t name)
+{
+    if (name == NAME_EMPTY) return "";
+
+    return EntryAt (&intern_shards[name & (INTERN_SHARDS - 1)], (name >> INTERN_SHARD_BITS) - 1)->text;
+}
+
+size_t NameLength (uint32_t name)
+{
+    if (name == NAME_EMPTY) return 0;
+
+    return EntryAt (&intern_shards[name & (INTERN_SHARDS - 1)], (name >> INTERN_SHARD_BITS) - 1)->len;
+}
+
+void GetInternStats (InternStats* stats)
+{
+    assert (stats);
+
+    *stats = {};
+
+    for (size_t i = 0; i < INTERN_SHARDS; i++)
+    {
+        InternShard* shard = &intern_shards[i];
+
+        shard->lock.lock ();
+
+        stats->labels       += shard->labels;
+        stats->label_bytes  += shard->label_bytes;
+        stats->strings      += shard->size;
+        stats->string_bytes += shard->string_bytes;
+        stats->memory       += shard->text.allocated + shard->capacity * sizeof (uint32_t) +
+                               shard->size * sizeof (InternEntry);
+
+        shard->lock.unlock ();
+    }
+}
+
+// how much the names would take one copy per node and how much they take in the table
+void PrintInternStats (FILE* file)
+{
+    assert (file);
+
+    InternStats stats = {};
+    GetInternStats (&stats);
+
+    fprintf (file, "Надписей: %zu, различных: %zu\n", stats.labels, stats.strings);
+
+    fputs ("Текст надписей: ", file);
+    PrintSize (file, stats.label_bytes);
+    fputs (", без повторов: ", file);
+    PrintSize (file, stats.string_bytes);
+    fputs (", таблица строк занимает ", file);
+    PrintSize (file, stats.memory);
+
+    if (stats.label_bytes > stats.memory)
+    {
+        fputs (", сэкономлено ", file);
+        PrintSize (file, stats.label_bytes - stats.memory);
+    }
+
+    fputc ('\n', file);
+}
+
+static InternEntry* EntryAt (const InternShard* shard, size_t place)
+{
+    size_t number = place + ((size_t) 1 << INTERN_CHUNK_BITS);
+    int    chunk  = 63 - __builtin_clzll (number) - INTERN_CHUNK_BITS;
+
+    return &shard->chunks[chunk][number - ((size_t) 1 << (chunk + INTERN_CHUNK_BITS))];
+}
+
+// open addressing with linear probing like the name index
+static uint32_t* FindSlot (const InternShard* shard, const char* name, size_t len, uint64_t hash)
+{
+    size_t   mask = shard->capacity - 1;
+    size_t   pos  = hash & mask;
+    uint32_t tag  = SlotTag (hash);
+
+    while (uint32_t slot = shard->slots[pos])
+    {
+        if ((slot & ~INTERN_PLACE_MASK) == tag)
+        {
+            const InternEntry* entry = EntryAt (shard, (slot & INTERN_PLACE_MASK) - 1);
+
+            if (entry->hash == (uint32_t) hash && entry->len == len && memcmp (entry->text, name, len) == 0)
+                break;
+        }
+
+        pos = (pos + 1) & mask;
+    }
+
+    return &shard->slots[pos];
+}
+
+// returns the place of the new entry plus one
+static uint32_t AddEntry (InternShard* shard, const char* name, size_t len, uint64_t hash)
+{
+    assert (shard->size <= INTERN_MAX_PLACE);
+    assert (len <= UINT32_MAX);
+
+    size_t place  = shard->size;
+    size_t number = place + ((size_t) 1 << INTERN_CHUNK_BITS);
+    int    chunk  = 63 - __builtin_clzll (number) - INTERN_CHUNK_BITS;
+
+    if (!shard->chunks[chunk])
+    {
+        shard->chunks[chunk] = (InternEntry*) calloc ((size_t) 1 << (chunk + INTERN_CHUNK_BITS),
+                                                      sizeof (InternEntry));
+        assert (shard->chunks[chunk]);
+    }
+
+    // small tables stay small, big ones do not end up with thousands of slabs
+    if (shard->text.allocated >= 4 * shard->text.slab_size && shard->text.slab_size < INTERN_MAX_SLAB)
+        shard->text.slab_size *= 2;
+
+    InternEntry* entry = EntryAt (shard, place);
+
+    entry->text = arena_strndup (&shard->text, name, len);
+    entry->len  = (uint32_t) len;
+    entry->hash = (uint32_t) hash;
+
+    shard->size++;
+    shard->string_bytes += len;
+
+    return (uint32_t) (place + 1);
+}
+
+static void ShardGrow (InternShard* shard)
+{
+    if (shard->capacity == 0)
+    {
+        arena_ctor (&shard->text, INTERN_MIN_SLAB);
+
+        shard->capacity = INTERN_MIN_SLOTS;
+        shard->slots    = (uint32_t*) calloc (shard->capacity, sizeof (uint32_t));
+        assert (shard->slots);
+
+        return;
+    }
+
+    uint32_t* old_slots    = shard->slots;
+    size_t    old_capacity = shard->capacity;
+
+    shard->capacity *= 2;
+    shard->slots = (uint32_t*) calloc (shard->capacity, sizeof (uint32_t));
+    assert (shard->slots);
+
+    size_t mask = shard->capacity - 1;
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (!old_slots[i]) continue;
+
+        size_t pos = EntryAt (shard, (old_slots[i] & INTERN_PLACE_MASK) - 1)->hash & mask;
+        while (shard->slots[pos]) pos = (pos + 1) & mask;
+
+        shard->slots[pos] = old_slots[i];
+    }
+
+    free (old_slots);
+}
+
+static uint32_t SlotTag (uint64_t hash)
+{
+    return (uint32_t) (hash >> INTERN_TAG_SHIFT) << INTERN_PLACE_BITS;
+}
+
+static size_t ShardOf (uint64_t hash)
+{
+    return (size_t) (hash >> (64 - INTERN_SHARD_BITS));
+}
+
+static void PrintSize (FILE* file, size_t bytes)
+{
+    if (bytes < 10 * 1024)
+        fprintf (file, "%zu Б", bytes);
+    else if (bytes < 10 * 1024 * 1024)
+        fprintf (file, "%.1f КБ", (double) bytes / 1024);
+    else
+        fprintf (file, "%.1f МБ", (double) bytes / 1024 / 1024);
+}
+
+// NameHash goes byte by byte, this one eight bytes at a time, which matters
+// when every name of a big base is hashed on load
+static uint64_t TextHash (const char* name, size_t len)
+{
+    const uint64_t multiplier = 0x9e3779b97f4a7c15;
+
+    uint64_t hash = len * multiplier;
+
+    for ( ; len >= sizeof (uint64_t); name += sizeof (uint64_t), len -= sizeof (uint64_t))
+    {
+        uint64_t word = 0;
+        memcpy (&word, name, sizeof (word));
+
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 32;
+    }
+
+    uint64_t tail = 0;
+    memcpy (&tail, name, len);
+
+    hash = (hash ^ tail) * multiplier;
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9;
+    hash ^= hash >> 32;
+
+    return hash;
+}
@@ -0,0 +1,393 @@
+#include "akinator.h"
+#include "journal.h"
+#include "utils.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+// One record per line, fields are separated with tabs:
+//
+//   <way from the root, L and R> \t <old answer> \t <question> \t <new answer> \n
+//
+// Tabs, newlines and backslashes inside names are escaped. A record without the
+// final newline is a torn write and is ignored. A record whose leaf is not where
+// it is expected has already been applied (the base was compacted but the journal
+// was not truncated yet) and is skipped as well.
+
+const char* const JOURNAL_SUFFIX = ".journal";
+const int         JOURNAL_FIELDS = 4;
+const size_t      JOURNAL_COPY_CHUNK = 64 * 1024;
+
+static char*  JournalPath    (const char* base);
+static bool   CreateJournal  (Journal* journal);
+static void   WriteEscaped   (FILE* file, const char* str, size_t len);
+static size_t Unescape       (char* str);
+static bool   ApplyRecord    (Tree* tree, char* line);
+static void*  CompactInBackground (void* journal);
+static bool   TrimJournal    (Journal* journal);
+
+bool JournalOpen (Journal* journal, Tree* tree, const char* base)
+{
+    assert (journal);
+    assert (tree);
+    assert (base);
+
+    *journal = {};
+
+    if (is_special_file (base)) return false;
+
+    journal->path = JournalPath (base);
+    journal->base = base;
+
+    tree->journal = journal;
+
+    return true;
+}
+
+// returns the number of applied records
+size_t JournalReplay (Tree* tree, const char* base)
+{
+    assert (tree);
+    assert (base);
+
+    if (is_special_file (base)) return 0;
+
+    char* path = JournalPath (base);
+    FILE* file = fopen (path, "r");
+    free (path);
+
+    if (!file) return 0;
+
+    char*   line     = nullptr;
+    size_t  capacity = 0;
+    ssize_t len      = 0;
+    size_t  applied  = 0;
+
+    while ((len = getline (&line, &capacity, file)) > 0)
+    {
+        if (line[len - 1] != '\n') break;
+        line[len - 1] = '\0';
+
+        if (ApplyRecord (tree, line)) applied++;
+    }
+
+    free (line);
+    fclose (file);
+
+    return applied;
+}
+
+// Is called right after the node has been split. Returns false if the record is
+// not on disk, the journal is then marked as failed.
+bool JournalAppend (Journal* journal, Node* node)
+{
+    assert (journal);
+    assert (node);
+    assert (node->left && node->right);
+
+    if (!journal->path || journal->failed) return false;
+
+    if (!journal->file && !CreateJournal (journal))
+    {
+        journal->failed = true;
+        return false;
+    }
+
+    char* way = (char*) calloc (node->depth + 1, sizeof (char));
+    assert (way);
+
+    size_t step = node->depth;
+    for (Node* child = node; child->parent; child = child->parent)
+    {
+        way[--step] = (child == child->parent->left) ? 'L' : 'R';
+    }
+
+    fputs (way, journal->file);
+    fputc ('\t', journal->file);
+    WriteEscaped (journal->file, NameText (node->right->name), NameLength (node->right->name));
+    fputc ('\t', journal->file);
+    WriteEscaped (journal->file, NameText (node->name), NameLength (node->name));
+    fputc ('\t', journal->file);
+    WriteEscaped (journal->file, NameText (node->left->name), NameLength (node->left->name));
+    fputc ('\n', journal->file);
+
+    free (way);
+
+    // a torn record would glue itself to the next one, so nothing is appended after it
+    if (fflush (journal->file) != 0 || fsync (fileno (journal->file)) != 0)
+    {
+        fclose (journal->file);
+        journal->file   = nullptr;
+        journal->failed = true;
+        return false;
+    }
+
+    journal->records++;
+
+    return true;
+}
+
+// writes a full snapshot of the tree over the base and empties the journal
+bool JournalCompact (Journal* journal, Tree* tree)
+{
+    assert (journal);
+    assert (tree);
+
+    if (!journal->path) return false;
+
+    // the base must not be written by two threads at once
+    JournalFinishCompact (journal, true);
+
+    if (!SaveTree (tree, journal->base, tree->format)) return false;
+
+    // a journal that is not open may still hold the records replayed at load or a torn one
+    if (!journal->file)
+    {
+        if (remove (journal->path) != 0 && errno != ENOENT) return false;
+    }
+    else if (ftruncate (fileno (journal->file), 0) != 0 || fsync (fileno (journal->file)) != 0) return false;
+
+    journal->records = 0;
+    journal->failed  = false;
+
+    return true;
+}
+
+// Saves a snapshot of the tree over the base on a thread of its own.
+// Returns false if the journal is closed, the last compaction is still running
+// or it has left fewer than JOURNAL_COMPACT_RECORDS records.
+bool JournalStartCompact (Journal* journal, Tree* tree)
+{
+    assert (journal);
+    assert (tree);
+
+    if (!journal->file) return false;
+
+    // the compaction that has just finished may have left only a few records
+    JournalFinishCompact (journal, false);
+    if (journal->compacting || journal->records < JOURNAL_COMPACT_RECORDS) return false;
+
+    struct stat info = {};
+    if (fflush (journal->file) != 0 || fstat (fileno (journal->file), &info) != 0) return false;
+
+    journal->compact_size    = (long) info.st_size;
+    journal->compact_records = journal->records;
+    journal->compact_saved   = false;
+    journal->compacted       = false;
+
+    TakeSnapshot (tree, &journal->snapshot);
+
+    if (pthread_create (&journal->compactor, nullptr, CompactInBackground, journal) != 0)
+    {
+        ReleaseSnapshot (&journal->snapshot);
+        return false;
+    }
+
+    journal->compacting = true;
+
+    return true;
+}
+
+// Joins the compactor once it is done, or waits for it, and drops the records the
+// new base already has. A crash in between leaves them in the journal, which is
+// harmless: the replay skips the records that are in the base already.
+// Returns false if the base or the journal could not be written.
+bool JournalFinishCompact (Journal* journal, bool wait)
+{
+    assert (journal);
+
+    if (!journal->compacting) return true;
+    if (!wait && !__atomic_load_n (&journal->compacted, __ATOMIC_ACQUIRE)) return true;
+
+    pthread_join (journal->compactor, nullptr);
+
+    journal->compacting = false;
+    ReleaseSnapshot (&journal->snapshot);
+
+    // after a failed append the journal is gone, the base is saved whole at exit
+    if (!journal->compact_saved || journal->failed || !TrimJournal (journal)) return false;
+
+    journal->records -= journal->compact_records;
+
+    return true;
+}
+
+void JournalClose (Journal* journal)
+{
+    assert (journal);
+
+    JournalFinishCompact (journal, true);
+
+    if (journal->file) fclose (journal->file);
+    free (journal->path);
+
+    *journal = {};
+}
+
+// for a base that has been replaced by another tree, returns false if the journal stays
+bool JournalRemove (const char* base)
+{
+    assert (base);
+
+    if (is_special_file (base)) return true;
+
+    char* path    = JournalPath (base);
+    bool  removed = remove (path) == 0 || errno == ENOENT;
+    free (path);
+
+    return removed;
+}
+
+static void* CompactInBackground (void* arg)
+{
+    Journal* journal = (Journal*) arg;
+
+    journal->compact_saved = SaveSnapshot (&journal->snapshot, journal->base, journal->snapshot.tree->format);
+
+    __atomic_store_n (&journal->compacted, true, __ATOMIC_RELEASE);
+
+    return nullptr;
+}
+
+// the records written after the snapshot go to a new journal, which replaces the old one
+static bool TrimJournal (Journal* journal)
+{
+    if (fflush (journal->file) != 0) return false;
+
+    FILE* old = fopen (journal->path, "r");
+    if (!old) return false;
+
+    size_t tmp_len  = strlen (journal->path) + sizeof (".tmp");
+    char*  tmp_name = (char*) calloc (tmp_len, sizeof (char));
+    assert (tmp_name);
+    snprintf (tmp_name, tmp_len, "%s.tmp", journal->path);
+
+    FILE* tmp  = fopen (tmp_name, "w");
+    char* copy = (char*) calloc (JOURNAL_COPY_CHUNK, sizeof (char));
+    assert (copy);
+
+    bool trimmed = tmp && fseek (old, journal->compact_size, SEEK_SET) == 0;
+
+    for (size_t len = 0; trimmed && (len = fread (copy, sizeof (char), JOURNAL_COPY_CHUNK, old)) > 0; )
+    {
+        trimmed = fwrite (copy, sizeof (char), len, tmp) == len;
+    }
+
+    trimmed = trimmed && !ferror (old) && fflush (tmp) == 0 && fsync (fileno (tmp)) == 0;
+
+    if (tmp)     trimmed = (fclose (tmp) == 0) && trimmed;
+    if (trimmed) trimmed = rename (tmp_name, journal->path) == 0;
+    if (!trimmed) remove (tmp_name);
+
+    fclose (old);
+    free (copy);
+    free (tmp_name);
+
+    if (!trimmed) return false;
+
+    // the old file is gone, appends go to the new one
+    fclose (journal->file);
+    journal->file = fopen (journal->path, "a");
+
+    return journal->file != nullptr && sync_parent_dir (journal->path);
+}
+
+static bool ApplyRecord (Tree* tree, char* line)
+{
+    char* fields[JOURNAL_FIELDS] = {};
+
+    for (int i = 0; i < JOURNAL_FIELDS; i++)
+    {
+        fields[i] = line;
+
+        line = strchr (line, '\t');
+        if (!line && i < JOURNAL_FIELDS - 1) return false;
+
+        if (line) *line++ = '\0';
+    }
+
+    Node* node = tree->root;
+
+    for (const char* way = fields[0]; *way != '\0'; way++)
+    {
+        if (!node->left || !node->right) return false;
+
+        node = (*way == 'L') ? node->left : node->right;
+    }
+
+    size_t old_len = Unescape (fields[1]);
+    if (node->left || node->right || node->name != FindName (fields[1], old_len)) return false;
+
+    size_t question_len = Unescape (fields[2]);
+    size_t object_len   = Unescape (fields[3]);
+
+    SplitLeaf (tree, node, fields[3], object_len, fields[2], question_len);
+
+    return true;
+}
+
+// opens the journal for appending, creating it if there is none
+static bool CreateJournal (Journal* journal)
+{
+    journal->file = fopen (journal->path, "a");
+
+    // the records are only as durable as the name of a journal that has just been created
+    if (journal->file && !sync_parent_dir (journal->path))
+    {
+        fclose (journal->file);
+        journal->file = nullptr;
+    }
+
+    return journal->file != nullptr;
+}
+
+static char* JournalPath (const char* base)
+{
+    size_t len  = strlen (base) + strlen (JOURNAL_SUFFIX) + 1;
+    char*  path = (char*) calloc (len, sizeof (char));
+    assert (path);
+
+    snprintf (path, len, "%s%s", base, JOURNAL_SUFFIX);
+
+    return path;
+}
+
+static void WriteEscaped (FILE* file, const char* str, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if      (str[i] == '\\') fputs ("\\\\", file);
+        else if (str[i] == '\t') fputs ("\\t",  file);
+        else if (str[i] == '\n') fputs ("\\n",  file);
+        else                     fputc (str[i], file);
+    }
+}
+
+// unescapes in place, returns the new length
+static size_t Unescape (char* str)
+{
+    char* write = str;
+
+    for (const char* read = str; *read != '\0'; read++)
+    {
+        if (*read == '\\' && *(read + 1) != '\0')
+        {
+            read++;
+
+            if      (*read == 't') *write++ = '\t';
+            else if (*read == 'n') *write++ = '\n';
+            else                   *write++ = *read;
+        }
+        else
+        {
+            *write++ = *read;
+        }
+    }
+
+    *write = '\0';
+
+    return (size_t) (write - str);
+}
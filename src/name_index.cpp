@@ -0,0 +1,215 @@
+#include "akinator.h"
+#include "trace.h"
+
+#include <cstdint>
+
+// open addressing with linear probing, the capacity is always a power of two.
+// Leaves are found by the id of their name, a name that is not in the string
+// table is not in the index either.
+
+const size_t INDEX_MIN_CAPACITY = 64;
+
+static Node**   FindSlot      (const NameIndex* index, uint32_t name);
+static size_t   SlotOf        (uint32_t name, size_t mask);
+static void     IndexGrow     (NameIndex* index);
+static size_t   AddLeaves     (NameIndex* index, Node* node);
+
+void IndexCtor (NameIndex* index)
+{
+    assert (index);
+
+    index->capacity = INDEX_MIN_CAPACITY;
+    index->size     = 0;
+    index->slots    = (Node**) calloc (index->capacity, sizeof (Node*));
+    assert (index->slots);
+}
+
+void IndexDtor (NameIndex* index)
+{
+    assert (index);
+
+    free (index->slots);
+
+    index->slots    = nullptr;
+    index->capacity = 0;
+    index->size     = 0;
+}
+
+// returns false if there already is a leaf with the same name,
+// the index then keeps pointing at the old one
+bool IndexInsert (NameIndex* index, Node* leaf)
+{
+    assert (index);
+    assert (leaf);
+
+    if (2 * (index->size + 1) > index->capacity) IndexGrow (index);
+
+    Node** slot = FindSlot (index, leaf->name);
+    if (*slot) return false;
+
+    *slot = leaf;
+    index->size++;
+
+    return true;
+}
+
+Node* IndexFind (const NameIndex* index, const char* name, size_t len)
+{
+    assert (index);
+    assert (name);
+
+    uint64_t start = TraceBegin ();
+
+    uint32_t id   = FindName (name, len);
+    Node*    leaf = (id != NAME_NONE) ? *FindSlot (index, id) : nullptr;
+
+    TraceEnd (TRACE_LOOKUP, start);
+
+    return leaf;
+}
+
+Node* IndexFindName (const NameIndex* index, uint32_t name)
+{
+    assert (index);
+
+    return *FindSlot (index, name);
+}
+
+// the leaf has moved to another node under the same name
+void IndexReplace (NameIndex* index, Node* old_leaf, Node* new_leaf)
+{
+    assert (index);
+    assert (old_leaf);
+    assert (new_leaf);
+
+    Node** slot = FindSlot (index, old_leaf->name);
+
+    if (*slot == old_leaf) *slot = new_leaf;
+}
+
+// an empty index big enough for the leaves, so that IndexInsertShared never has to grow it
+void IndexReserve (NameIndex* index, size_t leaves)
+{
+    assert (index);
+
+    size_t capacity = INDEX_MIN_CAPACITY;
+    while (capacity < 2 * leaves) capacity *= 2;
+
+    IndexDtor (index);
+
+    index->capacity = capacity;
+    index->slots    = (Node**) calloc (index->capacity, sizeof (Node*));
+    assert (index->slots);
+}
+
+// IndexInsert for several threads filling a reserved index at once. A slot is
+// taken with a compare-and-swap and never changes after that, so the probing
+// stays the same as in FindSlot. Of two equal names the one that came first
+// keeps the slot, the caller puts the first one in the tree there if it has to.
+bool IndexInsertShared (NameIndex* index, Node* leaf)
+{
+    assert (index);
+    assert (leaf);
+
+    size_t mask = index->capacity - 1;
+    size_t pos  = SlotOf (leaf->name, mask);
+
+    while (true)
+    {
+        Node* node = __atomic_load_n (&index->slots[pos], __ATOMIC_ACQUIRE);
+
+        if (!node && __atomic_compare_exchange_n (&index->slots[pos], &node, leaf, false,
+                                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            __atomic_fetch_add (&index->size, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+
+        // node is the leaf that has taken the slot
+        if (node->name == leaf->name) return false;
+
+        pos = (pos + 1) & mask;
+    }
+}
+
+// returns the number of leaves whose names are already taken
+size_t BuildIndex (Tree* tree)
+{
+    assert (tree);
+
+    // sized for all leaves at once, so the index is never rehashed while it is built
+    size_t leaves = 0;
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, RIGHT))
+    {
+        if (!node->left && !node->right) leaves++;
+    }
+
+    IndexReserve (&tree->index, leaves);
+
+    return AddLeaves (&tree->index, tree->root);
+}
+
+static size_t AddLeaves (NameIndex* index, Node* root)
+{
+    size_t duplicates = 0;
+
+    for (Node* node = root; node; node = NextPreOrder (node, root, SIZE_MAX, RIGHT))
+    {
+        if (node->left || node->right || IndexInsert (index, node)) continue;
+
+        fprintf (stderr, "Объект %.*s встречается в базе несколько раз\n", NODE_NAME (node));
+        duplicates++;
+    }
+
+    return duplicates;
+}
+
+static Node** FindSlot (const NameIndex* index, uint32_t name)
+{
+    size_t mask = index->capacity - 1;
+    size_t pos  = SlotOf (name, mask);
+
+    while (index->slots[pos] && index->slots[pos]->name != name)
+    {
+        pos = (pos + 1) & mask;
+    }
+
+    return &index->slots[pos];
+}
+
+// ids of one shard of the string table come in a row, so they are mixed first
+static size_t SlotOf (uint32_t name, size_t mask)
+{
+    return (size_t) (((uint64_t) name * 0x9e3779b97f4a7c15) >> 32) & mask;
+}
+
+static void IndexGrow (NameIndex* index)
+{
+    Node** old_slots    = index->slots;
+    size_t old_capacity = index->capacity;
+
+    index->capacity *= 2;
+    index->slots = (Node**) calloc (index->capacity, sizeof (Node*));
+    assert (index->slots);
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_slots[i]) *FindSlot (index, old_slots[i]->name) = old_slots[i];
+    }
+
+    free (old_slots);
+}
+
+// FNV-1a
+uint64_t NameHash (const char* name, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
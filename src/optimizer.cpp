@@ -0,0 +1,661 @@
+#include "akinator.h"
+#include "journal.h"
+#include "optimizer.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <cmath>
+#include <cstring>
+
+// Offline optimizer: akinator --optimize <base> <hits> <out>
+//
+// hits has one "<count>\t<name>" line per object, usually how many games ended
+// with it. The only answers a game knows about an object are the ones on its own
+// path, so the tree is rebuilt from the top: each question is one that every object
+// left below it has on its path, answered the same way each time, and of those the
+// one that splits their games most evenly. An object counts as its hits plus one
+// game, so objects missing from the file are not pushed to the bottom. Popular
+// objects move up, and a question that is already answered on the way is never
+// asked again, since it can not split anything.
+//
+// An object whose path answers some question both ways can only be reached the way
+// it was before: when no question splits the objects left, the one the old tree
+// asked to tell them apart is kept. No object is ever dropped. The new tree is
+// written only if it asks fewer questions per game than the old one, and the
+// counters of the base are removed, since they follow the old paths.
+
+const uint32_t NO_QUESTION         = UINT32_MAX;
+const size_t   OPTIMIZE_MAX_ANSWERS = (size_t) 1 << 26;    // 512 MB of answers
+
+enum AnswerWay
+{
+    ANSWER_LEFT,
+    ANSWER_RIGHT,
+    ANSWER_BOTH     // the path asks the question twice and answers it both ways
+};
+
+struct Answer
+{
+    uint32_t  question;    // dense number, see QuestionMap
+    AnswerWay way;
+};
+
+struct OptimizeLeaf
+{
+    Node*  node;
+    size_t games;          // hits + 1
+    size_t answers;        // the first one in OptimizeState::answers
+    size_t answers_num;    // sorted by question
+};
+
+// question name -> dense number, open addressing
+struct QuestionMap
+{
+    uint32_t* names;
+    uint32_t* numbers;
+    size_t    capacity;
+    size_t    size;
+
+    uint32_t* questions;    // dense number -> name
+};
+
+struct LeafRef
+{
+    Node*  node;
+    size_t leaf;
+};
+
+struct QuestionCount
+{
+    size_t objects;       // that answer it one way on their path
+    size_t games[2];      // by ANSWER_LEFT and ANSWER_RIGHT
+};
+
+struct OptimizeTask
+{
+    size_t begin;         // range of OptimizeState::order
+    size_t end;
+    Node*  copy;
+};
+
+struct OptimizeState
+{
+    OptimizeLeaf* leaves;
+    size_t        leaves_num;
+
+    Answer* answers;
+    size_t  answers_num;
+
+    size_t* order;        // leaf numbers, every task owns a range of it
+    size_t* buffer;
+
+    QuestionMap    map;
+    QuestionCount* counts;
+    uint32_t*      touched;
+
+    size_t empty;         // empty answers, they are not copied
+    size_t kept;          // questions taken from the old tree
+    double cost_before;   // questions per game, weighted like the split
+    double cost_after;
+};
+
+struct Hit
+{
+    const char* name;
+    size_t      name_len;
+    size_t      count;
+};
+
+static bool     CollectLeaves  (Tree* tree, OptimizeState* state);
+static int      CompareAnswers (const void* answer_1, const void* answer_2);
+static int      CompareRefs    (const void* ref_1, const void* ref_2);
+static void     AddAnswers     (OptimizeState* state, OptimizeLeaf* leaf);
+static uint32_t QuestionNumber (QuestionMap* map, uint32_t name);
+static void     CountHits      (Tree* tree, OptimizeState* state, Hit* hits, size_t hits_num);
+static void     Rebuild        (Tree* optimized, OptimizeState* state);
+static uint32_t BestQuestion   (OptimizeState* state, OptimizeTask* task);
+static size_t   SplitByAnswer  (OptimizeState* state, OptimizeTask* task, uint32_t question);
+static size_t   SplitAsBefore  (OptimizeState* state, OptimizeTask* task, Node** question);
+static AnswerWay FindAnswer    (OptimizeState* state, OptimizeLeaf* leaf, uint32_t question);
+static bool     IsUnder        (Node* node, Node* ancestor);
+static void     StateDtor      (OptimizeState* state);
+static Hit*     ReadHits       (char* buffer, size_t size, size_t* hits_num);
+static void     PathLength     (Tree* tree, Hit* hits, size_t hits_num, double* length, size_t* games);
+static double   MeanLeafDepth  (Node* root);
+
+int RunOptimize (const char* base, const char* hits_file, const char* out)
+{
+    assert (base);
+    assert (hits_file);
+    assert (out);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, base))
+    {
+        fprintf (stderr, "Не удалось прочитать базу %s\n", base);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    JournalReplay (&tree, base);
+
+    size_t hits_size = 0;
+    char*  hits_text = get_file_content (hits_file, &hits_size);
+    if (!hits_text)
+    {
+        fprintf (stderr, "Не удалось прочитать файл попаданий %s\n", hits_file);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    size_t hits_num = 0;
+    Hit*   hits     = ReadHits (hits_text, hits_size, &hits_num);
+
+    OptimizeState state = {};
+    if (!CollectLeaves (&tree, &state))
+    {
+        fprintf (stderr, "База %s слишком глубокая, чтобы ее перестроить\n", base);
+        StateDtor (&state);
+        TreeDtor (&tree);
+        free (hits);
+        free (hits_text);
+        return 1;
+    }
+
+    CountHits (&tree, &state, hits, hits_num);
+
+    Tree optimized = {};
+    TreeCtor (&optimized);
+    optimized.format = tree.format;
+
+    if (state.leaves_num > 0) Rebuild (&optimized, &state);
+    BuildIndex (&optimized);
+
+    double before = 0, after = 0;
+    size_t games  = 0, games_after = 0;
+    PathLength (&tree,      hits, hits_num, &before, &games);
+    PathLength (&optimized, hits, hits_num, &after,  &games_after);
+
+    printf ("Объектов: %zu, пустых ответов удалено: %zu, вопросов оставлено как было: %zu\n",
+            state.leaves_num, state.empty, state.kept);
+    printf ("Вопросов за игру по файлу попаданий (%zu игр): было %.3f, стало %.3f\n",
+            games, before, after);
+    printf ("Вопросов до объекта в среднем по базе: было %.3f, стало %.3f\n",
+            MeanLeafDepth (tree.root), MeanLeafDepth (optimized.root));
+
+    Tree* result = &optimized;
+
+    if (state.leaves_num == 0 || state.cost_after >= state.cost_before)
+    {
+        printf ("Новое дерево не короче, база записана без изменений\n");
+        result = &tree;
+    }
+
+    bool saved = true;
+
+    // the journal of the base describes the old tree, so it is compacted right away
+    if (strcmp (base, out) == 0)
+    {
+        Journal journal = {};
+        saved = JournalOpen (&journal, result, base) && JournalCompact (&journal, result);
+        JournalClose (&journal);
+    }
+    else
+    {
+        // whatever base was there before, its journal does not fit the new one
+        saved = SaveTree (result, out, result->format) && JournalRemove (out);
+    }
+
+    // the counters are kept by the way from the root, which has changed
+    if (saved && (result == &optimized || strcmp (base, out) != 0)) saved = StatsRemove (out);
+
+    if (!saved) fprintf (stderr, "Не удалось записать базу %s\n", out);
+
+    StateDtor (&state);
+    TreeDtor (&optimized);
+    TreeDtor (&tree);
+    free (hits);
+    free (hits_text);
+
+    return saved ? 0 : 1;
+}
+
+// Every leaf in pre-order, right branches first, with the answers on its path.
+// Returns false if the paths are too long to keep them all.
+static bool CollectLeaves (Tree* tree, OptimizeState* state)
+{
+    size_t questions = 0, answers = 0;
+
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, RIGHT))
+    {
+        if (node->left && node->right)
+        {
+            questions++;
+            continue;
+        }
+
+        // an empty answer is not an object, its question goes away if nothing else needs it
+        if (node->name == NAME_EMPTY)
+        {
+            state->empty++;
+            continue;
+        }
+
+        state->leaves_num++;
+        answers += node->depth - tree->root->depth;
+    }
+
+    if (answers > OPTIMIZE_MAX_ANSWERS) return false;
+
+    state->map.capacity = 64;
+    while (state->map.capacity < 2 * questions) state->map.capacity *= 2;
+
+    state->map.names     = (uint32_t*) calloc (state->map.capacity, sizeof (uint32_t));
+    state->map.numbers   = (uint32_t*) calloc (state->map.capacity, sizeof (uint32_t));
+    state->map.questions = (uint32_t*) calloc (questions + 1, sizeof (uint32_t));
+    assert (state->map.names && state->map.numbers && state->map.questions);
+
+    for (size_t i = 0; i < state->map.capacity; i++) state->map.names[i] = NAME_NONE;
+
+    state->answers = (Answer*) calloc (answers + 1, sizeof (Answer));
+
+    state->leaves = (OptimizeLeaf*) calloc (state->leaves_num, sizeof (OptimizeLeaf));
+    state->order  = (size_t*) calloc (state->leaves_num, sizeof (size_t));
+    state->buffer = (size_t*) calloc (state->leaves_num, sizeof (size_t));
+    assert (state->answers && state->leaves && state->order && state->buffer);
+
+    size_t leaf = 0;
+
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, RIGHT))
+    {
+        if ((node->left && node->right) || node->name == NAME_EMPTY) continue;
+
+        state->leaves[leaf] = {node, 1, state->answers_num, 0};
+        state->order[leaf]  = leaf;
+
+        AddAnswers (state, &state->leaves[leaf]);
+
+        leaf++;
+    }
+
+    state->counts  = (QuestionCount*) calloc (state->map.size + 1, sizeof (QuestionCount));
+    state->touched = (uint32_t*) calloc (state->map.size + 1, sizeof (uint32_t));
+    assert (state->counts && state->touched);
+
+    return true;
+}
+
+// the answers of a leaf sorted by question, one per question
+static void AddAnswers (OptimizeState* state, OptimizeLeaf* leaf)
+{
+    Answer* answers = state->answers + state->answers_num;
+    size_t  size    = 0;
+
+    for (Node* child = leaf->node; child->parent; child = child->parent)
+    {
+        AnswerWay way = (child == child->parent->left) ? ANSWER_LEFT : ANSWER_RIGHT;
+
+        answers[size++] = {QuestionNumber (&state->map, child->parent->name), way};
+    }
+
+    qsort (answers, size, sizeof (Answer), CompareAnswers);
+
+    size_t unique = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (unique > 0 && answers[unique - 1].question == answers[i].question)
+        {
+            if (answers[unique - 1].way != answers[i].way) answers[unique - 1].way = ANSWER_BOTH;
+            continue;
+        }
+
+        answers[unique++] = answers[i];
+    }
+
+    leaf->answers_num   = unique;
+    state->answers_num += unique;
+}
+
+static int CompareAnswers (const void* answer_1, const void* answer_2)
+{
+    uint32_t question_1 = ((const Answer*) answer_1)->question;
+    uint32_t question_2 = ((const Answer*) answer_2)->question;
+
+    return (question_1 > question_2) - (question_1 < question_2);
+}
+
+static uint32_t QuestionNumber (QuestionMap* map, uint32_t name)
+{
+    size_t slot = (size_t) (NameHash ((const char*) &name, sizeof (name)) & (map->capacity - 1));
+
+    while (map->names[slot] != NAME_NONE && map->names[slot] != name)
+    {
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+
+    if (map->names[slot] == NAME_NONE)
+    {
+        map->names[slot]     = name;
+        map->numbers[slot]   = (uint32_t) map->size;
+        map->questions[map->size++] = name;
+    }
+
+    return map->numbers[slot];
+}
+
+// the games of every leaf, the hits are matched by name like in PathLength
+static void CountHits (Tree* tree, OptimizeState* state, Hit* hits, size_t hits_num)
+{
+    LeafRef* refs = (LeafRef*) calloc (state->leaves_num, sizeof (LeafRef));
+    assert (refs);
+
+    for (size_t i = 0; i < state->leaves_num; i++) refs[i] = {state->leaves[i].node, i};
+
+    qsort (refs, state->leaves_num, sizeof (LeafRef), CompareRefs);
+
+    for (size_t i = 0; i < hits_num; i++)
+    {
+        LeafRef  key = {IndexFind (&tree->index, hits[i].name, hits[i].name_len), 0};
+        LeafRef* ref = (LeafRef*) bsearch (&key, refs, state->leaves_num, sizeof (LeafRef), CompareRefs);
+
+        if (ref) state->leaves[ref->leaf].games += hits[i].count;
+    }
+
+    free (refs);
+
+    double games = 0, depths = 0;
+
+    for (size_t i = 0; i < state->leaves_num; i++)
+    {
+        Node* node = state->leaves[i].node;
+
+        games  += (double) state->leaves[i].games;
+        depths += (double) state->leaves[i].games * (double) (node->depth - tree->root->depth);
+    }
+
+    state->cost_before = (games > 0) ? depths / games : 0;
+}
+
+static int CompareRefs (const void* ref_1, const void* ref_2)
+{
+    const Node* node_1 = ((const LeafRef*) ref_1)->node;
+    const Node* node_2 = ((const LeafRef*) ref_2)->node;
+
+    return (node_1 > node_2) - (node_1 < node_2);
+}
+
+// Builds the tree from the top, one range of leaves per task, without recursion.
+static void Rebuild (Tree* optimized, OptimizeState* state)
+{
+    size_t capacity = 64, size = 0;
+    OptimizeTask* tasks = (OptimizeTask*) calloc (capacity, sizeof (OptimizeTask));
+    assert (tasks);
+
+    tasks[size++] = {0, state->leaves_num, optimized->root};
+
+    double games = 0, depths = 0;
+
+    while (size > 0)
+    {
+        OptimizeTask task = tasks[--size];
+
+        if (task.end - task.begin == 1)
+        {
+            OptimizeLeaf* leaf = &state->leaves[state->order[task.begin]];
+
+            task.copy->name = leaf->node->name;
+
+            games  += (double) leaf->games;
+            depths += (double) leaf->games * (double) (task.copy->depth - optimized->root->depth);
+            continue;
+        }
+
+        size_t   middle   = 0;
+        uint32_t question = BestQuestion (state, &task);
+
+        if (question != NO_QUESTION)
+        {
+            middle = SplitByAnswer (state, &task, question);
+            task.copy->name = state->map.questions[question];
+        }
+        else
+        {
+            Node* asked = nullptr;
+            middle = SplitAsBefore (state, &task, &asked);
+            task.copy->name = asked->name;
+            state->kept++;
+        }
+
+        if (size + 2 > capacity)
+        {
+            capacity *= 2;
+            tasks = (OptimizeTask*) realloc (tasks, capacity * sizeof (OptimizeTask));
+            assert (tasks);
+        }
+
+        // the right branch comes first in the order, so it is built first
+        tasks[size++] = {middle,     task.end, CreateNode (optimized, task.copy, LEFT)};
+        tasks[size++] = {task.begin, middle,   CreateNode (optimized, task.copy, RIGHT)};
+    }
+
+    state->cost_after = depths / games;
+
+    free (tasks);
+}
+
+// The question every object of the task answers one way and that splits their
+// games most evenly, NO_QUESTION if there is none.
+static uint32_t BestQuestion (OptimizeState* state, OptimizeTask* task)
+{
+    size_t objects = task->end - task->begin;
+    size_t games   = 0;
+    size_t touched = 0;
+
+    for (size_t i = task->begin; i < task->end; i++)
+    {
+        OptimizeLeaf* leaf = &state->leaves[state->order[i]];
+        games += leaf->games;
+
+        for (size_t j = 0; j < leaf->answers_num; j++)
+        {
+            Answer* answer = &state->answers[leaf->answers + j];
+            if (answer->way == ANSWER_BOTH) continue;
+
+            QuestionCount* count = &state->counts[answer->question];
+            if (count->objects == 0) state->touched[touched++] = answer->question;
+
+            count->objects++;
+            count->games[answer->way] += leaf->games;
+        }
+    }
+
+    uint32_t best       = NO_QUESTION;
+    double   best_split = 0;
+
+    for (size_t i = 0; i < touched; i++)
+    {
+        QuestionCount* count = &state->counts[state->touched[i]];
+
+        if (count->objects == objects && count->games[ANSWER_LEFT] > 0 && count->games[ANSWER_RIGHT] > 0)
+        {
+            // the entropy of the answer, the most even split has the most
+            double left  = (double) count->games[ANSWER_LEFT] / (double) games;
+            double split = -left * log2 (left) - (1 - left) * log2 (1 - left);
+
+            if (split > best_split || (split == best_split && state->touched[i] < best))
+            {
+                best       = state->touched[i];
+                best_split = split;
+            }
+        }
+
+        *count = {};
+    }
+
+    return best;
+}
+
+// moves the objects answering "right" in front of the others, returns where they end
+static size_t SplitByAnswer (OptimizeState* state, OptimizeTask* task, uint32_t question)
+{
+    size_t right = task->begin, left = 0;
+
+    for (size_t i = task->begin; i < task->end; i++)
+    {
+        size_t leaf = state->order[i];
+
+        if (FindAnswer (state, &state->leaves[leaf], question) == ANSWER_RIGHT)
+            state->order[right++] = leaf;
+        else
+            state->buffer[left++] = leaf;
+    }
+
+    memcpy (state->order + right, state->buffer, left * sizeof (size_t));
+
+    return right;
+}
+
+// The objects of the task can not be told apart by a question they all answer one
+// way, so they are split by the question the old tree asked for them: the lowest
+// common one. The order stays the pre-order of the old tree, so the objects of its
+// right branch come first.
+static size_t SplitAsBefore (OptimizeState* state, OptimizeTask* task, Node** question)
+{
+    Node* first = state->leaves[state->order[task->begin]].node;
+    Node* last  = state->leaves[state->order[task->end - 1]].node;
+
+    Node* child_1 = nullptr, *child_2 = nullptr;
+    *question = CommonAncestor (first, last, &child_1, &child_2);
+
+    size_t low = task->begin, high = task->end - 1;
+
+    // the first object under the left branch
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+
+        if (IsUnder (state->leaves[state->order[middle]].node, (*question)->left))
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return low;
+}
+
+static AnswerWay FindAnswer (OptimizeState* state, OptimizeLeaf* leaf, uint32_t question)
+{
+    Answer* answers = state->answers + leaf->answers;
+    size_t  low = 0, high = leaf->answers_num;
+
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+
+        if (answers[middle].question < question)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    assert (low < leaf->answers_num && answers[low].question == question);
+
+    return answers[low].way;
+}
+
+static bool IsUnder (Node* node, Node* ancestor)
+{
+    while (node->depth > ancestor->depth) node = node->parent;
+
+    return node == ancestor;
+}
+
+static void StateDtor (OptimizeState* state)
+{
+    free (state->leaves);
+    free (state->answers);
+    free (state->order);
+    free (state->buffer);
+    free (state->map.names);
+    free (state->map.numbers);
+    free (state->map.questions);
+    free (state->counts);
+    free (state->touched);
+
+    *state = {};
+}
+
+// the names point into the buffer, which is kept until the end
+static Hit* ReadHits (char* buffer, size_t size, size_t* hits_num)
+{
+    size_t capacity = 64;
+    Hit*   hits     = (Hit*) calloc (capacity, sizeof (Hit));
+    assert (hits);
+
+    *hits_num = 0;
+
+    for (char* line = buffer; line < buffer + size; )
+    {
+        char* end = (char*) memchr (line, '\n', (size_t) (buffer + size - line));
+        if (!end) end = buffer + size;
+
+        char* name = nullptr;
+        long long count = strtoll (line, &name, 10);
+
+        if (name < end && *name == '\t' && count > 0)
+        {
+            name++;
+
+            size_t len = (size_t) (end - name);
+            if (len > 0 && name[len - 1] == '\r') len--;
+
+            if (*hits_num == capacity)
+            {
+                capacity *= 2;
+                hits = (Hit*) realloc (hits, capacity * sizeof (Hit));
+                assert (hits);
+            }
+
+            hits[(*hits_num)++] = {name, len, (size_t) count};
+        }
+
+        line = end + 1;
+    }
+
+    return hits;
+}
+
+// the mean depth of the objects weighted by their hits, unknown objects are skipped
+static void PathLength (Tree* tree, Hit* hits, size_t hits_num, double* length, size_t* games)
+{
+    double total = 0;
+    *games = 0;
+
+    for (size_t i = 0; i < hits_num; i++)
+    {
+        Node* leaf = IndexFind (&tree->index, hits[i].name, hits[i].name_len);
+        if (!leaf) continue;
+
+        total  += (double) hits[i].count * (double) (leaf->depth - tree->root->depth);
+        *games += hits[i].count;
+    }
+
+    *length = (*games > 0) ? total / (double) *games : 0;
+}
+
+static double MeanLeafDepth (Node* root)
+{
+    double total  = 0;
+    size_t leaves = 0;
+
+    for (Node* node = root; node; node = NextPreOrder (node, root, SIZE_MAX, RIGHT))
+    {
+        if (node->left || node->right) continue;
+
+        total += (double) (node->depth - root->depth);
+        leaves++;
+    }
+
+    return (leaves > 0) ? total / (double) leaves : 0;
+}
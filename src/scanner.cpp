@@ -0,0 +1,375 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <thread>
+
+#include "scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+
+// each block gives one bitmap word: bit i describes byte i of the block
+const size_t SCAN_BLOCK = 64;
+
+typedef void (*classify_func) (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks);
+
+static void          classify_scalar (const char* block, size_t len, uint64_t* marks, uint64_t* blanks, uint64_t* breaks);
+static classify_func choose_classify ();
+static bool          push_marks      (scan_index* index, uint64_t marks, size_t base);
+static bool          scan_parallel   (scan_index* index, const char* buffer, size_t threads);
+static bool          scan_part       (scan_index* part, const char* buffer, size_t from, size_t to);
+static void          scan_part_worker(scan_index* part, const char* buffer, size_t from, size_t to);
+
+#ifdef __SSE2__
+static void classify_sse2  (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks);
+#else
+static void classify_block (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks);
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    #define SCAN_HAVE_AVX2
+static void classify_avx2 (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks);
+#endif
+
+// below this size a single thread is faster than starting the others
+const size_t SCAN_PARALLEL_MIN = 1 << 22;
+
+bool scan_build (scan_index* index, const char* buffer, size_t length, size_t threads)
+{
+    assert (index);
+    assert (buffer);
+
+    size_t words = length / SCAN_BLOCK + 1;
+
+    *index = {};
+    index->length = length;
+    index->blanks = (uint64_t*) calloc (words, sizeof (uint64_t));
+    index->breaks = (uint64_t*) calloc (words, sizeof (uint64_t));
+
+    if (!index->blanks || !index->breaks)
+    {
+        scan_dtor (index);
+        return false;
+    }
+
+    if (threads > 1 && length >= SCAN_PARALLEL_MIN) return scan_parallel (index, buffer, threads);
+
+    if (!scan_part (index, buffer, 0, length))
+    {
+        scan_dtor (index);
+        return false;
+    }
+
+    return true;
+}
+
+// Every thread scans its own part of the buffer into the shared bitmaps, the parts
+// are cut at block boundaries so no bitmap word is written twice. The marks of the
+// parts are concatenated afterwards.
+static bool scan_parallel (scan_index* index, const char* buffer, size_t threads)
+{
+    size_t length = index->length;
+    size_t chunk  = (length / threads + SCAN_BLOCK - 1) / SCAN_BLOCK * SCAN_BLOCK;
+
+    scan_index*  parts   = (scan_index*)  calloc (threads, sizeof (scan_index));
+    std::thread* workers = new std::thread[threads];
+    assert (parts);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        size_t from = (i * chunk < length) ? i * chunk : length;
+        size_t to   = (i == threads - 1 || from + chunk > length) ? length : from + chunk;
+
+        parts[i].length = length;
+        parts[i].blanks = index->blanks;
+        parts[i].breaks = index->breaks;
+
+        workers[i] = std::thread (scan_part_worker, &parts[i], buffer, from, to);
+    }
+
+    bool   scanned = true;
+    size_t marks   = 0;
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers[i].join ();
+
+        scanned = scanned && parts[i].marks;
+        marks  += parts[i].size;
+    }
+
+    index->capacity = marks + 1;
+    index->marks    = (size_t*) calloc (index->capacity, sizeof (size_t));
+    scanned = scanned && index->marks;
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        if (scanned) memcpy (index->marks + index->size, parts[i].marks, parts[i].size * sizeof (size_t));
+        index->size += parts[i].size;
+
+        free (parts[i].marks);
+    }
+
+    delete[] workers;
+    free (parts);
+
+    if (!scanned) scan_dtor (index);
+
+    return scanned;
+}
+
+static void scan_part_worker (scan_index* part, const char* buffer, size_t from, size_t to)
+{
+    if (!scan_part (part, buffer, from, to))
+    {
+        free (part->marks);
+        part->marks = nullptr;
+    }
+}
+
+// scans [from, to), from is a multiple of SCAN_BLOCK
+static bool scan_part (scan_index* part, const char* buffer, size_t from, size_t to)
+{
+    // a name is about ten bytes long, the array grows if it is not enough
+    part->capacity = (to - from) / 8 + 16;
+    part->marks    = (size_t*) calloc (part->capacity, sizeof (size_t));
+    if (!part->marks) return false;
+
+    classify_func classify = choose_classify ();
+
+    size_t pos = from;
+    for (; pos + SCAN_BLOCK <= to; pos += SCAN_BLOCK)
+    {
+        uint64_t marks = 0;
+        classify (buffer + pos, &marks, &part->blanks[pos / SCAN_BLOCK], &part->breaks[pos / SCAN_BLOCK]);
+
+        if (marks && !push_marks (part, marks, pos)) return false;
+    }
+
+    if (pos < to)
+    {
+        uint64_t marks = 0;
+        classify_scalar (buffer + pos, to - pos, &marks,
+                         &part->blanks[pos / SCAN_BLOCK], &part->breaks[pos / SCAN_BLOCK]);
+
+        if (marks && !push_marks (part, marks, pos)) return false;
+    }
+
+    return true;
+}
+
+void scan_dtor (scan_index* index)
+{
+    assert (index);
+
+    free (index->marks);
+    free (index->blanks);
+    free (index->breaks);
+
+    *index = {};
+}
+
+const char* scan_kind ()
+{
+#ifdef SCAN_HAVE_AVX2
+    if (__builtin_cpu_supports ("avx2")) return "avx2";
+#endif
+
+#ifdef __SSE2__
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+// the first position in [from, to) that is not whitespace, or to
+size_t scan_skip_blanks (const scan_index* index, size_t from, size_t to)
+{
+    assert (index);
+    assert (to <= index->length);
+
+    while (from < to)
+    {
+        uint64_t word = ~index->blanks[from / SCAN_BLOCK] >> (from % SCAN_BLOCK);
+        if (word) return (from + __builtin_ctzll (word) < to) ? from + __builtin_ctzll (word) : to;
+
+        from += SCAN_BLOCK - from % SCAN_BLOCK;
+    }
+
+    return to;
+}
+
+// the end of [from, to) without its trailing whitespace
+size_t scan_trim_blanks (const scan_index* index, size_t from, size_t to)
+{
+    assert (index);
+    assert (to <= index->length);
+
+    while (to > from)
+    {
+        size_t   last = to - 1;
+        uint64_t word = ~index->blanks[last / SCAN_BLOCK] << (SCAN_BLOCK - 1 - last % SCAN_BLOCK);
+
+        if (word)
+        {
+            size_t end = last - __builtin_clzll (word) + 1;
+            return (end > from) ? end : from;
+        }
+
+        to = last - last % SCAN_BLOCK;
+    }
+
+    return from;
+}
+
+size_t scan_count_breaks (const scan_index* index, size_t from, size_t to)
+{
+    assert (index);
+    assert (to <= index->length);
+
+    size_t count = 0;
+
+    while (from < to)
+    {
+        size_t   shift = from % SCAN_BLOCK;
+        size_t   span  = (to - from < SCAN_BLOCK - shift) ? to - from : SCAN_BLOCK - shift;
+        uint64_t word  = index->breaks[from / SCAN_BLOCK] >> shift;
+
+        if (span < SCAN_BLOCK) word &= (1ULL << span) - 1;
+        count += (size_t) __builtin_popcountll (word);
+
+        from += span;
+    }
+
+    return count;
+}
+
+static bool push_marks (scan_index* index, uint64_t marks, size_t base)
+{
+    size_t count = (size_t) __builtin_popcountll (marks);
+
+    if (index->size + count > index->capacity)
+    {
+        size_t  capacity  = 2 * index->capacity + count;
+        size_t* new_marks = (size_t*) realloc (index->marks, capacity * sizeof (size_t));
+        if (!new_marks) return false;
+
+        index->marks    = new_marks;
+        index->capacity = capacity;
+    }
+
+    size_t* out = index->marks + index->size;
+    while (marks)
+    {
+        *out++ = base + (size_t) __builtin_ctzll (marks);
+        marks &= marks - 1;
+    }
+
+    index->size += count;
+
+    return true;
+}
+
+static classify_func choose_classify ()
+{
+#ifdef SCAN_HAVE_AVX2
+    if (__builtin_cpu_supports ("avx2")) return classify_avx2;
+#endif
+
+#ifdef __SSE2__
+    return classify_sse2;
+#else
+    return classify_block;
+#endif
+}
+
+#ifndef __SSE2__
+
+static void classify_block (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks)
+{
+    classify_scalar (block, SCAN_BLOCK, marks, blanks, breaks);
+}
+
+#endif
+
+static void classify_scalar (const char* block, size_t len, uint64_t* marks, uint64_t* blanks, uint64_t* breaks)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char ch = (unsigned char) block[i];
+
+        if (ch == '(' || ch == ')' || ch == '\0') *marks |= 1ULL << i;
+
+        if (ch == ' ') *blanks |= 1ULL << i;
+        else if (ch >= '\t' && ch <= '\r')
+        {
+            *blanks |= 1ULL << i;
+            *breaks |= 1ULL << i;
+        }
+    }
+}
+
+#ifdef __SSE2__
+
+static void classify_sse2 (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks)
+{
+    const __m128i open   = _mm_set1_epi8 ('(');
+    const __m128i close  = _mm_set1_epi8 (')');
+    const __m128i zero   = _mm_setzero_si128 ();
+    const __m128i space  = _mm_set1_epi8 (' ');
+    const __m128i tab    = _mm_set1_epi8 ('\t');
+    const __m128i breaks_span = _mm_set1_epi8 ('\r' - '\t');
+
+    for (size_t i = 0; i < SCAN_BLOCK; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128 ((const __m128i*) (block + i));
+
+        __m128i mark = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (bytes, open), _mm_cmpeq_epi8 (bytes, close)),
+                                     _mm_cmpeq_epi8 (bytes, zero));
+
+        // '\t' <= ch <= '\r' as an unsigned range check
+        __m128i shifted = _mm_sub_epi8 (bytes, tab);
+        __m128i brk     = _mm_cmpeq_epi8 (_mm_min_epu8 (shifted, breaks_span), shifted);
+        __m128i blank   = _mm_or_si128 (brk, _mm_cmpeq_epi8 (bytes, space));
+
+        *marks  |= (uint64_t) (uint16_t) _mm_movemask_epi8 (mark)  << i;
+        *blanks |= (uint64_t) (uint16_t) _mm_movemask_epi8 (blank) << i;
+        *breaks |= (uint64_t) (uint16_t) _mm_movemask_epi8 (brk)   << i;
+    }
+}
+
+#endif
+
+#ifdef SCAN_HAVE_AVX2
+
+__attribute__ ((target ("avx2")))
+static void classify_avx2 (const char* block, uint64_t* marks, uint64_t* blanks, uint64_t* breaks)
+{
+    const __m256i open   = _mm256_set1_epi8 ('(');
+    const __m256i close  = _mm256_set1_epi8 (')');
+    const __m256i zero   = _mm256_setzero_si256 ();
+    const __m256i space  = _mm256_set1_epi8 (' ');
+    const __m256i tab    = _mm256_set1_epi8 ('\t');
+    const __m256i breaks_span = _mm256_set1_epi8 ('\r' - '\t');
+
+    for (size_t i = 0; i < SCAN_BLOCK; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256 ((const __m256i*) (block + i));
+
+        __m256i mark = _mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (bytes, open),
+                                                         _mm256_cmpeq_epi8 (bytes, close)),
+                                        _mm256_cmpeq_epi8 (bytes, zero));
+
+        __m256i shifted = _mm256_sub_epi8 (bytes, tab);
+        __m256i brk     = _mm256_cmpeq_epi8 (_mm256_min_epu8 (shifted, breaks_span), shifted);
+        __m256i blank   = _mm256_or_si256 (brk, _mm256_cmpeq_epi8 (bytes, space));
+
+        *marks  |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (mark)  << i;
+        *blanks |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (blank) << i;
+        *breaks |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (brk)   << i;
+    }
+}
+
+#endif
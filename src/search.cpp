@@ -0,0 +1,747 @@
+#include "akinator.h"
+#include "search.h"
+
+#include <cstring>
+
+// Every name is kept twice: as it is, to get the leaf from the exact index, and
+// folded. The folded names are sorted for the prefix search; the names learned
+// since the last sort are kept apart and looked through one by one until there
+// are SEARCH_RECENT_MAX of them.
+//
+// For the similar names every folded name is cut into trigrams, with two padding
+// letters at each end. One edit breaks at most three trigrams, so a name within
+// k edits of a query of n letters shares at least n + 2 - 3k trigrams with it. Only
+// the names from the shortest lists that such a name can not miss are taken, and
+// of them only those found in enough of the other lists are compared letter by
+// letter. A list grows with the entries, so it is sorted, and all of them are
+// read once side by side.
+
+const size_t   SEARCH_RECENT_MAX = 1024;
+const size_t   SEARCH_SLAB_SIZE  = 1024 * 1024;
+const uint32_t SEARCH_PAD        = 0x110000;    // past the last code point
+const int      SEARCH_GRAM_BITS  = 21;
+
+struct SearchEntry
+{
+    const char* folded;
+    uint32_t    name;
+    uint32_t    folded_len;
+    uint32_t    letters;        // code points in the folded name
+};
+
+struct GramList
+{
+    uint64_t  gram;             // 0 in an empty slot
+    uint32_t* entries;
+    uint32_t  size;
+    uint32_t  capacity;
+};
+
+struct NameSearch
+{
+    arena strings;
+
+    SearchEntry* entries;
+    size_t       size;
+    size_t       capacity;
+
+    uint32_t* sorted;           // the first sorted_size entries by folded name
+    size_t    sorted_size;
+
+    GramList* grams;
+    size_t    grams_size;
+    size_t    grams_capacity;
+
+    // scratch of SearchSimilar, a cursor for every list
+    GramList** lists;
+    size_t     lists_capacity;
+    uint32_t*  cursors;
+    size_t     cursors_capacity;
+
+    uint32_t* candidates;
+    size_t    candidates_capacity;
+
+    uint32_t* query;
+    size_t    query_capacity;
+    uint32_t* letters;
+    size_t    letters_capacity;
+    size_t*   rows;
+    size_t    rows_capacity;
+};
+
+static NameSearch* GetSearch   (Tree* tree);
+static void*     Reserve       (void* data, size_t* capacity, size_t need, size_t elem_size);
+static size_t    FoldName      (const char* name, size_t len, char* folded);
+static uint32_t  FoldLetter    (uint32_t letter);
+static size_t    DecodeLetter  (const unsigned char* str, size_t len, uint32_t* letter);
+static size_t    EncodeLetter  (uint32_t letter, char* out);
+static size_t    DecodeName    (const char* folded, size_t len, uint32_t** letters, size_t* capacity);
+static void      AddEntry      (NameSearch* search, uint32_t name);
+static uint64_t  MakeGram      (const uint32_t* letters, size_t num, size_t pos);
+static GramList* FindGram      (NameSearch* search, uint64_t gram, bool insert);
+static void      AddGrams      (NameSearch* search, uint32_t entry, const uint32_t* letters, size_t num);
+static size_t    CollectCandidates (NameSearch* search, size_t grams, size_t need);
+static uint32_t  ListHead      (const GramList* list, uint32_t pos);
+static int       CompareLists  (const void* a, const void* b);
+static void      SortRecent    (NameSearch* search);
+static int       CompareEntries (const void* a, const void* b);
+static int       ComparePrefix (const SearchEntry* entry, const char* prefix, size_t len);
+static size_t    EditsAllowed  (size_t letters);
+static size_t    Distance      (NameSearch* search, const uint32_t* a, size_t a_len,
+                                                    const uint32_t* b, size_t b_len, size_t limit);
+static void      AddMatch      (SearchMatch* matches, size_t* found, size_t max, Node* leaf, size_t distance);
+static bool      HasLeaf       (Node** leaves, size_t num, Node* leaf);
+
+// qsort has no context argument
+static const SearchEntry* sort_entries = nullptr;
+
+NameSearch* SearchBuild (Tree* tree)
+{
+    assert (tree);
+
+    NameSearch* search = (NameSearch*) calloc (1, sizeof (NameSearch));
+    assert (search);
+
+    arena_ctor (&search->strings, SEARCH_SLAB_SIZE);
+
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, LEFT))
+    {
+        if (!node->left && !node->right) AddEntry (search, node->name);
+    }
+
+    SortRecent (search);
+
+    return search;
+}
+
+void SearchDtor (NameSearch* search)
+{
+    if (!search) return;
+
+    for (size_t i = 0; i < search->grams_capacity; i++) free (search->grams[i].entries);
+
+    arena_dtor (&search->strings);
+
+    free (search->entries);
+    free (search->sorted);
+    free (search->grams);
+    free (search->lists);
+    free (search->cursors);
+    free (search->candidates);
+    free (search->query);
+    free (search->letters);
+    free (search->rows);
+    free (search);
+}
+
+void SearchAdd (NameSearch* search, uint32_t name)
+{
+    assert (search);
+
+    AddEntry (search, name);
+
+    if (search->size - search->sorted_size >= SEARCH_RECENT_MAX) SortRecent (search);
+}
+
+// only the folded name is kept here, the name itself is in the string table
+static void AddEntry (NameSearch* search, uint32_t name)
+{
+    size_t len = NameLength (name);
+    if (len == 0) return;
+
+    char*  folded     = (char*) arena_alloc (&search->strings, 2 * len, 1);
+    size_t folded_len = FoldName (NameText (name), len, folded);
+
+    if (folded_len == 0) return;
+
+    search->entries = (SearchEntry*) Reserve (search->entries, &search->capacity, search->size + 1,
+                                              sizeof (SearchEntry));
+
+    uint32_t     index = (uint32_t) search->size++;
+    SearchEntry* entry = &search->entries[index];
+
+    entry->name       = name;
+    entry->folded     = folded;
+    entry->folded_len = (uint32_t) folded_len;
+    entry->letters    = (uint32_t) DecodeName (folded, folded_len, &search->letters, &search->letters_capacity);
+
+    AddGrams (search, index, search->letters, entry->letters);
+}
+
+size_t SearchPrefix (Tree* tree, const char* prefix, size_t len, Node** leaves, size_t max)
+{
+    assert (tree);
+    assert (prefix);
+    assert (leaves);
+
+    NameSearch* search = GetSearch (tree);
+
+    char*  folded     = (char*) calloc (2 * len + 1, sizeof (char));
+    assert (folded);
+    size_t folded_len = FoldName (prefix, len, folded);
+
+    size_t found = 0;
+
+    if (folded_len > 0)
+    {
+        size_t left = 0, right = search->sorted_size;
+
+        while (left < right)
+        {
+            size_t middle = left + (right - left) / 2;
+
+            if (ComparePrefix (&search->entries[search->sorted[middle]], folded, folded_len) < 0)
+                left  = middle + 1;
+            else
+                right = middle;
+        }
+
+        for (size_t i = left; i < search->sorted_size && found < max; i++)
+        {
+            const SearchEntry* entry = &search->entries[search->sorted[i]];
+            if (ComparePrefix (entry, folded, folded_len) != 0) break;
+
+            Node* leaf = IndexFindName (&tree->index, entry->name);
+            if (leaf && !HasLeaf (leaves, found, leaf)) leaves[found++] = leaf;
+        }
+
+        for (size_t i = search->sorted_size; i < search->size && found < max; i++)
+        {
+            const SearchEntry* entry = &search->entries[i];
+            if (ComparePrefix (entry, folded, folded_len) != 0) continue;
+
+            Node* leaf = IndexFindName (&tree->index, entry->name);
+            if (leaf && !HasLeaf (leaves, found, leaf)) leaves[found++] = leaf;
+        }
+    }
+
+    free (folded);
+
+    return found;
+}
+
+size_t SearchSimilar (Tree* tree, const char* name, size_t len, SearchMatch* matches, size_t max)
+{
+    assert (tree);
+    assert (name);
+    assert (matches);
+
+    NameSearch* search = GetSearch (tree);
+
+    char*  folded     = (char*) calloc (2 * len + 1, sizeof (char));
+    assert (folded);
+    size_t folded_len = FoldName (name, len, folded);
+    size_t letters    = DecodeName (folded, folded_len, &search->query, &search->query_capacity);
+
+    free (folded);
+
+    if (letters == 0 || max == 0) return 0;
+
+    size_t edits = EditsAllowed (letters);
+    size_t grams = letters + 2;
+    size_t need  = (grams > 3 * edits) ? grams - 3 * edits : 1;
+
+    // every name that shares need trigrams with the query is in one of the
+    // grams - need + 1 shortest lists, the longer ones are not read at all
+    search->lists = (GramList**) Reserve (search->lists, &search->lists_capacity, grams, sizeof (GramList*));
+
+    for (size_t pos = 0; pos < grams; pos++)
+    {
+        search->lists[pos] = FindGram (search, MakeGram (search->query, letters, pos), false);
+    }
+
+    qsort (search->lists, grams, sizeof (GramList*), CompareLists);
+
+    size_t candidates = CollectCandidates (search, grams, need);
+    size_t found      = 0;
+
+    for (size_t i = 0; i < candidates; i++)
+    {
+        const SearchEntry* entry = &search->entries[search->candidates[i]];
+
+        if (entry->letters > letters + edits || letters > entry->letters + edits) continue;
+
+        size_t other    = DecodeName (entry->folded, entry->folded_len, &search->letters,
+                                      &search->letters_capacity);
+        size_t distance = Distance (search, search->query, letters, search->letters, other, edits);
+        if (distance > edits) continue;
+
+        Node* leaf = IndexFindName (&tree->index, entry->name);
+        if (leaf) AddMatch (matches, &found, max, leaf, distance);
+    }
+
+    return found;
+}
+
+size_t SearchSuggest (Tree* tree, const char* name, size_t len, Node** leaves, size_t max)
+{
+    assert (tree);
+    assert (name);
+    assert (leaves);
+
+    SearchMatch* matches = (SearchMatch*) calloc (max + 1, sizeof (SearchMatch));
+    assert (matches);
+
+    size_t found = SearchSimilar (tree, name, len, matches, max);
+    for (size_t i = 0; i < found; i++) leaves[i] = matches[i].leaf;
+
+    free (matches);
+
+    if (found == max) return found;
+
+    Node** prefixed = (Node**) calloc (max, sizeof (Node*));
+    assert (prefixed);
+
+    size_t prefixed_num = SearchPrefix (tree, name, len, prefixed, max);
+
+    for (size_t i = 0; i < prefixed_num && found < max; i++)
+    {
+        if (!HasLeaf (leaves, found, prefixed[i])) leaves[found++] = prefixed[i];
+    }
+
+    free (prefixed);
+
+    return found;
+}
+
+// the object with the name as it is or, if only one fits, up to case and spaces
+Node* SearchFind (Tree* tree, const char* name, size_t len)
+{
+    assert (tree);
+    assert (name);
+
+    Node* object = IndexFind (&tree->index, name, len);
+    if (object) return object;
+
+    SearchMatch matches[2] = {};
+    size_t      found      = SearchSimilar (tree, name, len, matches, 2);
+
+    if (found >= 1 && matches[0].distance == 0 && (found == 1 || matches[1].distance > 0))
+        return matches[0].leaf;
+
+    return nullptr;
+}
+
+static NameSearch* GetSearch (Tree* tree)
+{
+    if (!tree->search) tree->search = SearchBuild (tree);
+
+    return tree->search;
+}
+
+static void* Reserve (void* data, size_t* capacity, size_t need, size_t elem_size)
+{
+    if (need <= *capacity) return data;
+
+    size_t new_capacity = (*capacity > 0) ? *capacity : 64;
+    while (new_capacity < need) new_capacity *= 2;
+
+    data = realloc (data, new_capacity * elem_size);
+    assert (data);
+
+    *capacity = new_capacity;
+
+    return data;
+}
+
+// lower case, ё as е, no spaces at the ends and one space between words;
+// folded has to fit 2 * len bytes, a byte that is not UTF-8 takes two
+static size_t FoldName (const char* name, size_t len, char* folded)
+{
+    const unsigned char* str = (const unsigned char*) name;
+
+    size_t folded_len = 0;
+    bool   space      = false;
+
+    for (size_t pos = 0; pos < len; )
+    {
+        uint32_t letter = 0;
+        pos += DecodeLetter (str + pos, len - pos, &letter);
+
+        if (letter == ' ' || letter == '\t' || letter == '\n' || letter == '\r' || letter == '\v' || letter == '\f')
+        {
+            space = (folded_len > 0);
+            continue;
+        }
+
+        if (space) folded[folded_len++] = ' ';
+        space = false;
+
+        folded_len += EncodeLetter (FoldLetter (letter), folded + folded_len);
+    }
+
+    return folded_len;
+}
+
+static uint32_t FoldLetter (uint32_t letter)
+{
+    if (letter >= 'A'    && letter <= 'Z')                     return letter + ('a' - 'A');
+    if (letter >= 0x00C0 && letter <= 0x00DE && letter != 0xD7) return letter + 0x20;     // Latin-1
+    if (letter == 0x0401 || letter == 0x0451)                  return 0x0435;              // Ё, ё
+    if (letter >= 0x0400 && letter <= 0x040F)                  return letter + 0x50;       // Ѐ..Џ
+    if (letter >= 0x0410 && letter <= 0x042F)                  return letter + 0x20;       // А..Я
+
+    return letter;
+}
+
+// a byte that does not start a valid sequence is taken as a Latin-1 letter
+static size_t DecodeLetter (const unsigned char* str, size_t len, uint32_t* letter)
+{
+    unsigned char first = str[0];
+
+    size_t   size = 0;
+    uint32_t code = 0;
+
+    if      (first < 0x80)           { *letter = first; return 1; }
+    else if ((first & 0xE0) == 0xC0) { size = 2; code = first & 0x1F; }
+    else if ((first & 0xF0) == 0xE0) { size = 3; code = first & 0x0F; }
+    else if ((first & 0xF8) == 0xF0) { size = 4; code = first & 0x07; }
+
+    if (size == 0 || size > len)
+    {
+        *letter = first;
+        return 1;
+    }
+
+    for (size_t i = 1; i < size; i++)
+    {
+        if ((str[i] & 0xC0) != 0x80)
+        {
+            *letter = first;
+            return 1;
+        }
+
+        code = (code << 6) | (str[i] & 0x3F);
+    }
+
+    *letter = code;
+
+    return size;
+}
+
+static size_t EncodeLetter (uint32_t letter, char* out)
+{
+    if (letter < 0x80)
+    {
+        out[0] = (char) letter;
+        return 1;
+    }
+
+    if (letter < 0x800)
+    {
+        out[0] = (char) (0xC0 | (letter >> 6));
+        out[1] = (char) (0x80 | (letter & 0x3F));
+        return 2;
+    }
+
+    if (letter < 0x10000)
+    {
+        out[0] = (char) (0xE0 |  (letter >> 12));
+        out[1] = (char) (0x80 | ((letter >> 6) & 0x3F));
+        out[2] = (char) (0x80 |  (letter & 0x3F));
+        return 3;
+    }
+
+    out[0] = (char) (0xF0 |  (letter >> 18));
+    out[1] = (char) (0x80 | ((letter >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((letter >> 6)  & 0x3F));
+    out[3] = (char) (0x80 |  (letter & 0x3F));
+    return 4;
+}
+
+// a folded name is valid UTF-8, so every letter decodes to itself
+static size_t DecodeName (const char* folded, size_t len, uint32_t** letters, size_t* capacity)
+{
+    *letters = (uint32_t*) Reserve (*letters, capacity, len + 1, sizeof (uint32_t));
+
+    size_t num = 0;
+
+    for (size_t pos = 0; pos < len; )
+    {
+        pos += DecodeLetter ((const unsigned char*) folded + pos, len - pos, &(*letters)[num++]);
+    }
+
+    return num;
+}
+
+// the trigram that ends at pos of the name padded with two letters at each end
+static uint64_t MakeGram (const uint32_t* letters, size_t num, size_t pos)
+{
+    uint64_t gram = 0;
+
+    for (size_t i = pos; i < pos + 3; i++)
+    {
+        uint32_t letter = (i < 2 || i - 2 >= num) ? SEARCH_PAD : letters[i - 2];
+
+        gram = (gram << SEARCH_GRAM_BITS) | letter;
+    }
+
+    return gram | (1ull << 63);
+}
+
+static GramList* FindGram (NameSearch* search, uint64_t gram, bool insert)
+{
+    if (insert && 2 * (search->grams_size + 1) > search->grams_capacity)
+    {
+        size_t    old_capacity = search->grams_capacity;
+        GramList* old_grams    = search->grams;
+
+        search->grams_capacity = (old_capacity > 0) ? 2 * old_capacity : 1024;
+        search->grams = (GramList*) calloc (search->grams_capacity, sizeof (GramList));
+        assert (search->grams);
+
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if (old_grams[i].gram == 0) continue;
+
+            size_t slot = (old_grams[i].gram * 0x9E3779B97F4A7C15ull) >> 20 & (search->grams_capacity - 1);
+            while (search->grams[slot].gram != 0) slot = (slot + 1) & (search->grams_capacity - 1);
+
+            search->grams[slot] = old_grams[i];
+        }
+
+        free (old_grams);
+    }
+
+    if (search->grams_capacity == 0) return nullptr;
+
+    size_t slot = (gram * 0x9E3779B97F4A7C15ull) >> 20 & (search->grams_capacity - 1);
+
+    while (search->grams[slot].gram != 0)
+    {
+        if (search->grams[slot].gram == gram) return &search->grams[slot];
+
+        slot = (slot + 1) & (search->grams_capacity - 1);
+    }
+
+    if (!insert) return nullptr;
+
+    search->grams[slot].gram = gram;
+    search->grams_size++;
+
+    return &search->grams[slot];
+}
+
+static void AddGrams (NameSearch* search, uint32_t entry, const uint32_t* letters, size_t num)
+{
+    for (size_t pos = 0; pos < num + 2; pos++)
+    {
+        GramList* list = FindGram (search, MakeGram (letters, num, pos), true);
+
+        // a trigram met twice in one name is listed once
+        if (list->size > 0 && list->entries[list->size - 1] == entry) continue;
+
+        if (list->size == list->capacity)
+        {
+            list->capacity = (list->capacity > 0) ? 2 * list->capacity : 4;
+            list->entries  = (uint32_t*) realloc (list->entries, list->capacity * sizeof (uint32_t));
+            assert (list->entries);
+        }
+
+        list->entries[list->size++] = entry;
+    }
+}
+
+// The entries of the first grams - need + 1 lists that are in need lists in all,
+// in their order. The lists are walked together from the smallest entry, a
+// longer one is only read up to the entry at hand and not at all once the
+// entry has enough lists or can not get them.
+static size_t CollectCandidates (NameSearch* search, size_t grams, size_t need)
+{
+    size_t short_lists = grams - need + 1;
+
+    search->cursors = (uint32_t*) Reserve (search->cursors, &search->cursors_capacity, grams, sizeof (uint32_t));
+    memset (search->cursors, 0, grams * sizeof (uint32_t));
+
+    size_t candidates = 0;
+
+    while (true)
+    {
+        uint32_t entry = UINT32_MAX;
+
+        for (size_t i = 0; i < short_lists; i++)
+        {
+            uint32_t head = ListHead (search->lists[i], search->cursors[i]);
+            if (head < entry) entry = head;
+        }
+
+        if (entry == UINT32_MAX) break;
+
+        size_t shared = 0;
+
+        for (size_t i = 0; i < short_lists; i++)
+        {
+            if (ListHead (search->lists[i], search->cursors[i]) != entry) continue;
+
+            search->cursors[i]++;
+            shared++;
+        }
+
+        for (size_t i = short_lists; i < grams && shared < need && shared + (grams - i) >= need; i++)
+        {
+            while (ListHead (search->lists[i], search->cursors[i]) < entry) search->cursors[i]++;
+
+            if (ListHead (search->lists[i], search->cursors[i]) == entry) shared++;
+        }
+
+        if (shared < need) continue;
+
+        search->candidates = (uint32_t*) Reserve (search->candidates, &search->candidates_capacity,
+                                                  candidates + 1, sizeof (uint32_t));
+        search->candidates[candidates++] = entry;
+    }
+
+    return candidates;
+}
+
+// UINT32_MAX past the end
+static uint32_t ListHead (const GramList* list, uint32_t pos)
+{
+    return (list && pos < list->size) ? list->entries[pos] : UINT32_MAX;
+}
+
+// a missing list is empty and goes first
+static int CompareLists (const void* a, const void* b)
+{
+    const GramList* list_a = *(GramList* const*) a;
+    const GramList* list_b = *(GramList* const*) b;
+
+    uint32_t size_a = list_a ? list_a->size : 0;
+    uint32_t size_b = list_b ? list_b->size : 0;
+
+    return (size_a > size_b) - (size_a < size_b);
+}
+
+// sorts the recent entries and merges them into the sorted ones
+static void SortRecent (NameSearch* search)
+{
+    size_t recent_num = search->size - search->sorted_size;
+    if (recent_num == 0) return;
+
+    uint32_t* recent = (uint32_t*) calloc (recent_num, sizeof (uint32_t));
+    uint32_t* merged = (uint32_t*) calloc (search->size, sizeof (uint32_t));
+    assert (recent);
+    assert (merged);
+
+    for (size_t i = 0; i < recent_num; i++) recent[i] = (uint32_t) (search->sorted_size + i);
+
+    sort_entries = search->entries;
+    qsort (recent, recent_num, sizeof (uint32_t), CompareEntries);
+
+    size_t old_i = 0, new_i = 0, out = 0;
+
+    while (old_i < search->sorted_size && new_i < recent_num)
+    {
+        if (CompareEntries (&search->sorted[old_i], &recent[new_i]) <= 0)
+            merged[out++] = search->sorted[old_i++];
+        else
+            merged[out++] = recent[new_i++];
+    }
+
+    while (old_i < search->sorted_size) merged[out++] = search->sorted[old_i++];
+    while (new_i < recent_num)          merged[out++] = recent[new_i++];
+
+    free (recent);
+    free (search->sorted);
+
+    search->sorted      = merged;
+    search->sorted_size = search->size;
+}
+
+static int CompareEntries (const void* a, const void* b)
+{
+    const SearchEntry* entry_a = &sort_entries[*(const uint32_t*) a];
+    const SearchEntry* entry_b = &sort_entries[*(const uint32_t*) b];
+
+    size_t len = (entry_a->folded_len < entry_b->folded_len) ? entry_a->folded_len : entry_b->folded_len;
+
+    int cmp = memcmp (entry_a->folded, entry_b->folded, len);
+    if (cmp != 0) return cmp;
+
+    return (entry_a->folded_len > entry_b->folded_len) - (entry_a->folded_len < entry_b->folded_len);
+}
+
+// 0 if the entry starts with the prefix, otherwise the order of the entry against it
+static int ComparePrefix (const SearchEntry* entry, const char* prefix, size_t len)
+{
+    size_t common = (entry->folded_len < len) ? entry->folded_len : len;
+
+    int cmp = memcmp (entry->folded, prefix, common);
+    if (cmp != 0) return cmp;
+
+    return (entry->folded_len < len) ? -1 : 0;
+}
+
+// a short name has too many neighbours to guess which one was meant
+static size_t EditsAllowed (size_t letters)
+{
+    if (letters <= 3)  return 0;
+    if (letters <= 7)  return 1;
+    if (letters <= 14) return 2;
+
+    return 3;
+}
+
+// Levenshtein distance, anything above limit is reported as limit + 1
+static size_t Distance (NameSearch* search, const uint32_t* a, size_t a_len,
+                                            const uint32_t* b, size_t b_len, size_t limit)
+{
+    search->rows = (size_t*) Reserve (search->rows, &search->rows_capacity, 2 * (b_len + 1), sizeof (size_t));
+
+    size_t* prev = search->rows;
+    size_t* cur  = search->rows + b_len + 1;
+
+    for (size_t j = 0; j <= b_len; j++) prev[j] = j;
+
+    for (size_t i = 1; i <= a_len; i++)
+    {
+        cur[0] = i;
+        size_t row_min = cur[0];
+
+        for (size_t j = 1; j <= b_len; j++)
+        {
+            size_t best = prev[j - 1] + (a[i - 1] != b[j - 1]);
+
+            if (prev[j]    + 1 < best) best = prev[j]    + 1;
+            if (cur[j - 1] + 1 < best) best = cur[j - 1] + 1;
+
+            cur[j] = best;
+            if (best < row_min) row_min = best;
+        }
+
+        if (row_min > limit) return limit + 1;
+
+        size_t* swap = prev;
+        prev = cur;
+        cur  = swap;
+    }
+
+    return (prev[b_len] > limit) ? limit + 1 : prev[b_len];
+}
+
+// keeps the closest matches, the earlier one wins a tie
+static void AddMatch (SearchMatch* matches, size_t* found, size_t max, Node* leaf, size_t distance)
+{
+    for (size_t i = 0; i < *found; i++)
+    {
+        if (matches[i].leaf == leaf) return;
+    }
+
+    if (*found == max && matches[max - 1].distance <= distance) return;
+
+    size_t i = (*found < max) ? (*found)++ : max - 1;
+
+    for ( ; i > 0 && matches[i - 1].distance > distance; i--) matches[i] = matches[i - 1];
+
+    matches[i] = {leaf, distance};
+}
+
+static bool HasLeaf (Node** leaves, size_t num, Node* leaf)
+{
+    for (size_t i = 0; i < num; i++)
+    {
+        if (leaves[i] == leaf) return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,612 @@
+#include "akinator.h"
+#include "journal.h"
+#include "server.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Every connection plays guessing games one after another against the same
+// in-memory tree. All sessions run in one epoll loop: a session only does a few
+// steps down the tree per input line, so the loop never blocks, and since the
+// tree is changed by the same thread that walks it, readers never need a lock.
+// Learned answers go to the journal of the base right away, and the base is
+// rewritten from a snapshot in the background, so the sessions do not wait for it.
+// The journal record itself is synced on the loop though: a learned answer is on
+// disk before the reply is sent, and every session waits for that one fsync. If a
+// record can not be written, the server warns once and rewrites the base at exit.
+// The stats counters are saved on the loop too, once in STATS_SAVE_PERIOD seconds
+// of play, and that save walks the whole tree.
+//
+// A client that stops reading is not read from either once SERVER_MAX_OUTPUT
+// bytes of replies wait for it, so it can not make the server buffer without
+// limit. A client that has closed its end still gets all the replies before the
+// connection is closed.
+
+const int    SERVER_BACKLOG      = 128;
+const int    SERVER_MAX_EVENTS   = 64;
+const size_t SERVER_READ_CHUNK   = 4096;
+const size_t SERVER_MAX_LINE     = 64 * 1024;
+const size_t SERVER_MAX_OUTPUT   = 64 * 1024;    // of unsent replies before reading stops
+
+const char* const SERVER_GREETING = "Если ответ на вопрос да - введите \"да\", "
+                                    "если ответ нет - введите \"нет\"\n";
+
+struct Buffer
+{
+    char*  data;
+    size_t size;
+    size_t capacity;
+};
+
+struct Client
+{
+    int fd;
+
+    Session session;
+
+    Buffer in;
+    Buffer out;
+    size_t out_sent;
+
+    uint32_t events;         // the epoll events the client is watched for
+    bool     read_closed;    // the client has sent everything it will send
+};
+
+struct Server
+{
+    Tree* tree;
+
+    int listen_fd;
+    int epoll_fd;
+};
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void    StopServer      (int signal);
+static int     OpenListener    (const char* socket_path);
+static void    AcceptClients   (Server* server);
+static bool    ReadClient      (Server* server, Client* client);
+static bool    FlushClient     (Server* server, Client* client);
+static void    CloseClient     (Server* server, Client* client);
+static void    StartSession    (Server* server, Client* client);
+static void    ClientSay       (void* context, const char* text);
+static void    BufferAppend    (Buffer* buffer, const char* data, size_t size);
+static int     ConnectServer   (const char* socket_path);
+static bool    SetNonBlocking  (int fd);
+static bool    WriteAll        (int fd, const char* data, size_t size);
+static double  Now             ();
+
+int RunServer (const char* base, const char* socket_path)
+{
+    assert (base);
+    assert (socket_path);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, base))
+    {
+        fprintf (stderr, "Не удалось прочитать базу %s\n", base);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    size_t replayed = JournalReplay (&tree, base);
+    StatsLoad (&tree, base);
+
+    PrintInternStats (stderr);
+
+    // without a journal the base is rewritten at exit, the way it always was
+    Journal journal = {};
+    JournalOpen (&journal, &tree, base);
+    bool journal_warned = false;
+
+    Server server = {};
+    server.tree      = &tree;
+    server.listen_fd = OpenListener (socket_path);
+    server.epoll_fd  = epoll_create1 (0);
+
+    if (server.listen_fd < 0 || server.epoll_fd < 0)
+    {
+        perror ("server");
+        JournalClose (&journal);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    epoll_event event = {};
+    event.events   = EPOLLIN;
+    event.data.ptr = nullptr;
+    epoll_ctl (server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+
+    signal (SIGINT,  StopServer);
+    signal (SIGTERM, StopServer);
+    signal (SIGPIPE, SIG_IGN);
+
+    fprintf (stderr, "Акинатор слушает %s\n", socket_path);
+
+    epoll_event events[SERVER_MAX_EVENTS] = {};
+
+    time_t stats_saved_at = time (nullptr);
+
+    while (!server_stop)
+    {
+        TracePoll ();
+        StatsSaveDue (&tree, base, &stats_saved_at);
+
+        // wakes up at least once a period to save the counters of an idle server
+        int nevents = epoll_wait (server.epoll_fd, events, SERVER_MAX_EVENTS, (int) STATS_SAVE_PERIOD * 1000);
+        if (nevents < 0)
+        {
+            if (errno == EINTR) continue;
+            perror ("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < nevents; i++)
+        {
+            Client* client = (Client*) events[i].data.ptr;
+
+            if (client == nullptr)
+            {
+                AcceptClients (&server);
+                continue;
+            }
+
+            bool alive = true;
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) alive = ReadClient (&server, client);
+            if (alive) alive = FlushClient (&server, client);
+
+            if (!alive) CloseClient (&server, client);
+        }
+
+        if (journal.failed && !journal_warned)
+        {
+            fprintf (stderr, "Не удалось записать ответ в журнал базы %s, база будет сохранена целиком при выходе\n", base);
+            journal_warned = true;
+        }
+    }
+
+    close (server.listen_fd);
+    close (server.epoll_fd);
+    unlink (socket_path);
+
+    bool saved = true;
+
+    if (journal.path)
+    {
+        if (replayed > 0 || journal.records > 0 || journal.failed) saved = JournalCompact (&journal, &tree);
+    }
+    else if (tree.version > 0)
+    {
+        saved = SaveTree (&tree, base, tree.format);
+    }
+
+    if (!saved) fprintf (stderr, "Не удалось сохранить базу %s\n", base);
+
+    JournalClose (&journal);
+
+    StatsSave (&tree, base);
+
+    TreeDtor (&tree);
+
+    return 0;
+}
+
+static void StopServer (int signal)
+{
+    (void) signal;
+
+    server_stop = 1;
+}
+
+static int OpenListener (const char* socket_path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (strlen (socket_path) >= sizeof (address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy (address.sun_path, socket_path);
+
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    unlink (socket_path);
+
+    if (bind (fd, (sockaddr*) &address, sizeof (address)) != 0 ||
+        listen (fd, SERVER_BACKLOG) != 0 || !SetNonBlocking (fd))
+    {
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void AcceptClients (Server* server)
+{
+    while (true)
+    {
+        int fd = accept (server->listen_fd, nullptr, nullptr);
+        if (fd < 0) return;
+
+        if (!SetNonBlocking (fd))
+        {
+            close (fd);
+            continue;
+        }
+
+        Client* client = (Client*) calloc (1, sizeof (Client));
+        assert (client);
+        client->fd     = fd;
+        client->events = EPOLLIN;
+
+        epoll_event event = {};
+        event.events   = EPOLLIN;
+        event.data.ptr = client;
+        epoll_ctl (server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+        StartSession (server, client);
+
+        if (!FlushClient (server, client)) CloseClient (server, client);
+    }
+}
+
+// feeds every complete line to the session, returns false if the client has gone
+static bool ReadClient (Server* server, Client* client)
+{
+    char chunk[SERVER_READ_CHUNK] = "";
+
+    while (!client->read_closed && client->out.size - client->out_sent < SERVER_MAX_OUTPUT)
+    {
+        ssize_t nread = read (client->fd, chunk, sizeof (chunk));
+
+        if (nread < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        if (nread == 0)
+        {
+            client->read_closed = true;
+            break;
+        }
+
+        BufferAppend (&client->in, chunk, (size_t) nread);
+
+        char*  line = client->in.data;
+        char*  end  = client->in.data + client->in.size;
+        char*  eol  = nullptr;
+
+        while ((eol = (char*) memchr (line, '\n', (size_t) (end - line))) != nullptr)
+        {
+            SessionFeed (&client->session, line, (size_t) (eol - line));
+
+            if (client->session.state == SESSION_OVER)
+            {
+                SessionEnd (&client->session);
+                StartSession (server, client);
+            }
+
+            line = eol + 1;
+        }
+
+        client->in.size = (size_t) (end - line);
+        memmove (client->in.data, line, client->in.size);
+
+        if (client->in.size > SERVER_MAX_LINE) return false;
+    }
+
+    return true;
+}
+
+// Returns false if the client has gone or has got everything it is going to get.
+// Reading stops while too many replies wait and resumes once they are sent.
+static bool FlushClient (Server* server, Client* client)
+{
+    while (client->out_sent < client->out.size)
+    {
+        ssize_t nwritten = write (client->fd, client->out.data + client->out_sent,
+                                  client->out.size - client->out_sent);
+        if (nwritten < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            break;
+        }
+
+        client->out_sent += (size_t) nwritten;
+    }
+
+    if (client->out_sent == client->out.size)
+    {
+        client->out.size = 0;
+        client->out_sent = 0;
+    }
+
+    if (client->read_closed && client->out.size == 0) return false;
+
+    uint32_t events = 0;
+    if (!client->read_closed && client->out.size - client->out_sent < SERVER_MAX_OUTPUT) events |= EPOLLIN;
+    if (client->out.size > 0) events |= EPOLLOUT;
+
+    if (events != client->events)
+    {
+        epoll_event event = {};
+        event.events   = events;
+        event.data.ptr = client;
+        epoll_ctl (server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+
+        client->events = events;
+    }
+
+    return true;
+}
+
+static void CloseClient (Server* server, Client* client)
+{
+    epoll_ctl (server->epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
+    close (client->fd);
+
+    SessionEnd (&client->session);
+
+    free (client->in.data);
+    free (client->out.data);
+    free (client);
+}
+
+static void StartSession (Server* server, Client* client)
+{
+    ClientSay (client, SERVER_GREETING);
+    SessionStart (&client->session, server->tree, ClientSay, client);
+}
+
+static void ClientSay (void* context, const char* text)
+{
+    Client* client = (Client*) context;
+
+    BufferAppend (&client->out, text, strlen (text));
+}
+
+static void BufferAppend (Buffer* buffer, const char* data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : SERVER_READ_CHUNK;
+        while (capacity < buffer->size + size) capacity *= 2;
+
+        buffer->data = (char*) realloc (buffer->data, capacity);
+        assert (buffer->data);
+        buffer->capacity = capacity;
+    }
+
+    memcpy (buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+// forwards stdin to the server and everything the server says to stdout
+int RunClient (const char* socket_path)
+{
+    assert (socket_path);
+
+    int fd = ConnectServer (socket_path);
+    if (fd < 0)
+    {
+        perror ("connect");
+        return 1;
+    }
+
+    pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+    char chunk[SERVER_READ_CHUNK] = "";
+
+    while (poll (fds, 2, -1) >= 0)
+    {
+        if (fds[1].revents)
+        {
+            ssize_t nread = read (fd, chunk, sizeof (chunk));
+            if (nread <= 0) break;
+
+            WriteAll (STDOUT_FILENO, chunk, (size_t) nread);
+        }
+
+        if (fds[0].revents)
+        {
+            ssize_t nread = read (STDIN_FILENO, chunk, sizeof (chunk));
+            if (nread <= 0)
+            {
+                shutdown (fd, SHUT_WR);
+                fds[0].fd = -1;
+                continue;
+            }
+
+            if (!WriteAll (fd, chunk, (size_t) nread)) break;
+        }
+    }
+
+    close (fd);
+
+    return 0;
+}
+
+// Load generator: every client plays the given number of games answering the
+// questions at random and agreeing with every guess, so the base is not changed.
+// A reply is complete when it ends with a question.
+int RunLoad (const char* socket_path, int clients, int games)
+{
+    assert (socket_path);
+
+    if (clients <= 0 || games <= 0)
+    {
+        fprintf (stderr, "Число клиентов и игр должно быть положительным\n");
+        return 1;
+    }
+
+    pollfd* fds       = (pollfd*) calloc ((size_t) clients, sizeof (pollfd));
+    Buffer* replies   = (Buffer*) calloc ((size_t) clients, sizeof (Buffer));
+    int*    played    = (int*)    calloc ((size_t) clients, sizeof (int));
+    double* sent_at   = (double*) calloc ((size_t) clients, sizeof (double));
+    assert (fds && replies && played && sent_at);
+
+    for (int i = 0; i < clients; i++)
+    {
+        fds[i].fd     = ConnectServer (socket_path);
+        fds[i].events = POLLIN;
+
+        if (fds[i].fd < 0)
+        {
+            perror ("connect");
+            for (int j = 0; j < i; j++) close (fds[j].fd);
+
+            free (fds);
+            free (replies);
+            free (played);
+            free (sent_at);
+
+            return 1;
+        }
+
+        sent_at[i] = Now ();
+    }
+
+    unsigned seed      = (unsigned) time (nullptr);
+    int      active    = clients;
+    long     requests  = 0;
+    double   wait_time = 0;
+    double   start     = Now ();
+
+    char chunk[SERVER_READ_CHUNK] = "";
+
+    while (active > 0 && poll (fds, (nfds_t) clients, -1) >= 0)
+    {
+        for (int i = 0; i < clients; i++)
+        {
+            if (fds[i].fd < 0 || !fds[i].revents) continue;
+
+            ssize_t nread = read (fds[i].fd, chunk, sizeof (chunk));
+            if (nread <= 0)
+            {
+                fprintf (stderr, "Сервер закрыл соединение\n");
+                close (fds[i].fd);
+                fds[i].fd = -1;
+                active--;
+                continue;
+            }
+
+            BufferAppend (&replies[i], chunk, (size_t) nread);
+
+            size_t size = replies[i].size;
+            if (size < 2 || memcmp (replies[i].data + size - 2, "?\n", 2) != 0) continue;
+
+            wait_time += Now () - sent_at[i];
+            requests++;
+
+            if (memmem (replies[i].data, size, "Ха я гений", strlen ("Ха я гений")) && ++played[i] == games)
+            {
+                close (fds[i].fd);
+                fds[i].fd = -1;
+                active--;
+                continue;
+            }
+
+            const char* reply = nullptr;
+
+            if (memmem (replies[i].data, size, "Я знаю ответ!", strlen ("Я знаю ответ!")))
+                reply = "да\n";
+            else
+                reply = (rand_r (&seed) % 2) ? "да\n" : "нет\n";
+
+            replies[i].size = 0;
+            sent_at[i] = Now ();
+
+            if (!WriteAll (fds[i].fd, reply, strlen (reply)))
+            {
+                close (fds[i].fd);
+                fds[i].fd = -1;
+                active--;
+            }
+        }
+    }
+
+    double total = Now () - start;
+
+    printf ("клиентов: %d, игр: %ld, запросов: %ld\n", clients, (long) clients * games, requests);
+    printf ("время: %.3f с, игр в секунду: %.1f, запросов в секунду: %.1f\n",
+            total, (double) clients * games / total, (double) requests / total);
+    printf ("средняя задержка ответа: %.1f мкс\n", requests ? 1e6 * wait_time / (double) requests : 0.0);
+
+    for (int i = 0; i < clients; i++) free (replies[i].data);
+    free (fds);
+    free (replies);
+    free (played);
+    free (sent_at);
+
+    return 0;
+}
+
+static int ConnectServer (const char* socket_path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (strlen (socket_path) >= sizeof (address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy (address.sun_path, socket_path);
+
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (connect (fd, (sockaddr*) &address, sizeof (address)) != 0)
+    {
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool SetNonBlocking (int fd)
+{
+    int flags = fcntl (fd, F_GETFL, 0);
+
+    return flags >= 0 && fcntl (fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool WriteAll (int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t nwritten = write (fd, data, size);
+        if (nwritten < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        data += nwritten;
+        size -= (size_t) nwritten;
+    }
+
+    return true;
+}
+
+static double Now ()
+{
+    timespec time = {};
+    clock_gettime (CLOCK_MONOTONIC, &time);
+
+    return (double) time.tv_sec + 1e-9 * (double) time.tv_nsec;
+}
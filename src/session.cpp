@@ -0,0 +1,189 @@
+#include "session.h"
+#include "stats.h"
+
+#include <cctype>
+#include <cstdarg>
+#include <cstring>
+
+static void SessionSay    (Session* session, const char* format, ...);
+static void AskNode       (Session* session);
+static void Learn         (Session* session, const char* question, size_t question_len);
+static bool IsAnswer      (const char* line, size_t len, const char* answer);
+
+void SessionStart (Session* session, Tree* tree, SayFunc say, void* context)
+{
+    assert (session);
+    assert (tree);
+    assert (say);
+
+    *session = {};
+
+    session->tree    = tree;
+    session->node    = tree->root;
+    session->say     = say;
+    session->context = context;
+
+    AskNode (session);
+}
+
+void SessionFeed (Session* session, const char* line, size_t len)
+{
+    assert (session);
+    assert (line);
+
+    // the base loader trims names the same way, so learned names survive a reload
+    while (len > 0 && isspace ((unsigned char) line[len - 1])) len--;
+    while (len > 0 && isspace ((unsigned char) *line)) { line++; len--; }
+
+    Node* node = session->node;
+
+    switch (session->state)
+    {
+    case SESSION_QUESTION:
+        if (!node->left || !node->right)
+        {
+            AskNode (session);
+            break;
+        }
+
+        if (IsAnswer (line, len, "да"))
+        {
+            StatsCount (session->tree, node, STATS_YES);
+            session->node = node->left;
+        }
+        else if (IsAnswer (line, len, "нет"))
+        {
+            StatsCount (session->tree, node, STATS_NO);
+            session->node = node->right;
+        }
+        else
+        {
+            SessionSay (session, "Некорректный ввод! Попробуйте еще\n");
+            break;
+        }
+
+        AskNode (session);
+        break;
+
+    case SESSION_GUESS:
+        if (IsAnswer (line, len, "да"))
+        {
+            StatsCountGame (session->tree, node, STATS_YES);
+            SessionSay (session, "Ха я гений\n");
+            session->state = SESSION_OVER;
+        }
+        else if (node->left && node->right)
+        {
+            // somebody has split this leaf while we were waiting for the answer,
+            // so there is one more question to ask
+            AskNode (session);
+        }
+        else
+        {
+            StatsCountGame (session->tree, node, STATS_NO);
+            SessionSay (session, "И кто же это?\n"
+                                 "Это ");
+            session->state = SESSION_NEW_OBJECT;
+        }
+        break;
+
+    case SESSION_NEW_OBJECT:
+        // the line may hold a '\0', so it is copied by its length
+        session->new_object = (char*) calloc (len + 1, sizeof (char));
+        assert (session->new_object);
+        memcpy (session->new_object, line, len);
+        session->new_object_len = len;
+
+        SessionSay (session, "А чем %.*s отличается от %.*s?\n"
+                             "Он(а/o) ", (int) len, session->new_object, NODE_NAME (node));
+        session->state = SESSION_DIFFERENCE;
+        break;
+
+    case SESSION_DIFFERENCE:
+        Learn (session, line, len);
+        session->state = SESSION_OVER;
+        break;
+
+    case SESSION_OVER:
+    default:
+        break;
+    }
+}
+
+void SessionEnd (Session* session)
+{
+    assert (session);
+
+    free (session->new_object);
+
+    session->new_object     = nullptr;
+    session->new_object_len = 0;
+    session->state          = SESSION_OVER;
+}
+
+static void AskNode (Session* session)
+{
+    Node* node = session->node;
+
+    StatsCount (session->tree, node, STATS_REACHED);
+
+    if (node->left && node->right)
+    {
+        SessionSay (session, "%.*s?\n", NODE_NAME (node));
+        session->state = SESSION_QUESTION;
+    }
+    else
+    {
+        SessionSay (session, "Я знаю ответ! Это %.*s?\n", NODE_NAME (node));
+        session->state = SESSION_GUESS;
+    }
+}
+
+static void Learn (Session* session, const char* question, size_t question_len)
+{
+    Node* leaf = session->node;
+
+    if (leaf->left || leaf->right)
+    {
+        SessionSay (session, "Пока мы играли, базу успели дополнить. Попробуйте сыграть еще раз\n");
+        return;
+    }
+
+    // counted before the split, so the counters move to the old answer along with its name
+    StatsCount (session->tree, leaf, STATS_WRONG);
+
+    if (!SplitLeaf (session->tree, leaf, session->new_object, session->new_object_len,
+                    question, question_len))
+    {
+        fprintf (stderr, "Объект %.*s уже есть в базе\n", (int) session->new_object_len, session->new_object);
+    }
+
+    session->learned = true;
+}
+
+static bool IsAnswer (const char* line, size_t len, const char* answer)
+{
+    return len == strlen (answer) && memcmp (line, answer, len) == 0;
+}
+
+static void SessionSay (Session* session, const char* format, ...)
+{
+    va_list args;
+
+    va_start (args, format);
+    int len = vsnprintf (nullptr, 0, format, args);
+    va_end (args);
+
+    if (len < 0) return;
+
+    char* text = (char*) calloc ((size_t) len + 1, sizeof (char));
+    assert (text);
+
+    va_start (args, format);
+    vsnprintf (text, (size_t) len + 1, format, args);
+    va_end (args);
+
+    session->say (session->context, text);
+
+    free (text);
+}
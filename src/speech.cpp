@@ -0,0 +1,403 @@
+#include "akinator.h"
+#include "speech.h"
+#include "trace.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Every line becomes one festival command. With audio_mode async festival plays a
+// line in the background and goes on to synthesize the next one. A new line is
+// saved to the cache right after it is played, the names and questions of the base
+// come up again and again and are then only loaded from the cache.
+//
+// Lines with the names the player has typed are cached too, so the cache is kept
+// under a size limit: a played file is touched, and when a new line is synthesized
+// the files that have not been played for the longest time are deleted.
+
+const char* const SPEECH_DEFAULT_COMMAND    = "festival --language russian --pipe";
+const char* const SPEECH_DEFAULT_CACHE      = ".tts_cache";
+const size_t      SPEECH_DEFAULT_CACHE_SIZE = 64;    // MB
+const size_t      SPEECH_MAX_ARGS           = 32;
+
+struct Utterance
+{
+    char*      text;
+    Utterance* next;
+};
+
+struct CacheFile
+{
+    char   name[32];
+    time_t played;
+    size_t size;
+};
+
+static pid_t       speech_child      = -1;
+static FILE*       speech_pipe       = nullptr;
+static const char* speech_cache      = nullptr;
+static size_t      speech_cache_size = 0;    // bytes
+
+static pthread_t       speech_writer;
+static pthread_mutex_t speech_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  speech_ready = PTHREAD_COND_INITIALIZER;
+
+// the queue and the flags are guarded by speech_lock
+static Utterance* speech_head     = nullptr;
+static Utterance* speech_tail     = nullptr;
+static bool       speech_stopping = false;
+static bool       speech_broken   = false;
+
+static pid_t StartSynthesizer (const char* command, int* input);
+static void* WriteUtterances  (void* arg);
+static bool  SendUtterance    (const char* text);
+static char* CachePath        (const char* text);
+static void  TrimCache        ();
+static int   CompareCacheFiles (const void* file_1, const void* file_2);
+static void  WriteString      (const char* str);
+static bool  IsBlank          (const char* str);
+
+bool SpeechStart ()
+{
+    if (speech_pipe) return true;
+
+    const char* command = getenv ("AKINATOR_TTS");
+    if (!command || !*command) command = SPEECH_DEFAULT_COMMAND;
+
+    speech_cache = getenv ("AKINATOR_TTS_CACHE");
+    if (!speech_cache || !*speech_cache) speech_cache = SPEECH_DEFAULT_CACHE;
+
+    if (mkdir (speech_cache, 0755) != 0 && errno != EEXIST)
+        fprintf (stderr, "Не удалось создать каталог %s, реплики не будут кэшироваться\n", speech_cache);
+
+    const char* cache_size = getenv ("AKINATOR_TTS_CACHE_SIZE");
+    speech_cache_size = ((cache_size && atol (cache_size) > 0) ? (size_t) atol (cache_size)
+                                                                : SPEECH_DEFAULT_CACHE_SIZE) << 20;
+
+    // a synthesizer that has died must not take the game with it
+    signal (SIGPIPE, SIG_IGN);
+
+    int input = -1;
+    speech_child = StartSynthesizer (command, &input);
+    if (speech_child < 0) return false;
+
+    speech_pipe = fdopen (input, "w");
+    assert (speech_pipe);
+
+    fputs ("(audio_mode 'async)\n", speech_pipe);
+    fflush (speech_pipe);
+
+    speech_stopping = false;
+    speech_broken   = false;
+
+    if (pthread_create (&speech_writer, nullptr, WriteUtterances, nullptr) != 0)
+    {
+        fclose (speech_pipe);
+        waitpid (speech_child, nullptr, 0);
+
+        speech_pipe  = nullptr;
+        speech_child = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// the text is copied, the call never waits for the synthesizer
+void SpeechSay (const char* text)
+{
+    assert (text);
+
+    if (!speech_pipe || IsBlank (text)) return;
+
+    Utterance* utterance = (Utterance*) calloc (1, sizeof (Utterance));
+    assert (utterance);
+
+    utterance->text = strdup (text);
+    assert (utterance->text);
+
+    pthread_mutex_lock (&speech_lock);
+
+    if (speech_broken)
+    {
+        pthread_mutex_unlock (&speech_lock);
+
+        free (utterance->text);
+        free (utterance);
+        return;
+    }
+
+    if (speech_tail) speech_tail->next = utterance;
+    else             speech_head       = utterance;
+
+    speech_tail = utterance;
+
+    pthread_cond_signal (&speech_ready);
+    pthread_mutex_unlock (&speech_lock);
+}
+
+// the lines already queued are still spoken
+void SpeechStop ()
+{
+    if (!speech_pipe) return;
+
+    pthread_mutex_lock (&speech_lock);
+    speech_stopping = true;
+    pthread_cond_signal (&speech_ready);
+    pthread_mutex_unlock (&speech_lock);
+
+    pthread_join (speech_writer, nullptr);
+
+    // waits until the last line has been played
+    fputs ("(audio_mode 'close)\n", speech_pipe);
+    fclose (speech_pipe);
+
+    waitpid (speech_child, nullptr, 0);
+
+    speech_pipe  = nullptr;
+    speech_child = -1;
+}
+
+// runs the command without a shell, its stdin is returned in input
+static pid_t StartSynthesizer (const char* command, int* input)
+{
+    char* args = strdup (command);
+    assert (args);
+
+    char*  argv[SPEECH_MAX_ARGS + 1] = {};
+    size_t argc = 0;
+
+    char* save = nullptr;
+    for (char* arg = strtok_r (args, " \t", &save); arg && argc < SPEECH_MAX_ARGS;
+               arg = strtok_r (nullptr, " \t", &save))
+    {
+        argv[argc++] = arg;
+    }
+
+    int fds[2] = {};
+    if (argc == 0 || pipe2 (fds, O_CLOEXEC) != 0)
+    {
+        free (args);
+        return -1;
+    }
+
+    pid_t pid = fork ();
+    if (pid == 0)
+    {
+        dup2 (fds[0], STDIN_FILENO);
+
+        // festival answers every command, the game's output must stay clean
+        int null = open ("/dev/null", O_WRONLY);
+        if (null >= 0) dup2 (null, STDOUT_FILENO);
+
+        execvp (argv[0], argv);
+
+        fprintf (stderr, "Не удалось запустить синтезатор речи %s\n", argv[0]);
+        _exit (127);
+    }
+
+    close (fds[0]);
+    free (args);
+
+    if (pid < 0)
+    {
+        close (fds[1]);
+        return -1;
+    }
+
+    *input = fds[1];
+
+    return pid;
+}
+
+static void* WriteUtterances (void* arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock (&speech_lock);
+
+    while (true)
+    {
+        while (!speech_head && !speech_stopping) pthread_cond_wait (&speech_ready, &speech_lock);
+
+        Utterance* utterance = speech_head;
+        if (!utterance) break;
+
+        speech_head = utterance->next;
+        if (!speech_head) speech_tail = nullptr;
+
+        bool broken = speech_broken;
+
+        pthread_mutex_unlock (&speech_lock);
+
+        bool sent = broken || SendUtterance (utterance->text);
+
+        free (utterance->text);
+        free (utterance);
+
+        pthread_mutex_lock (&speech_lock);
+
+        if (!sent && !speech_broken)
+        {
+            fprintf (stderr, "Синтезатор речи не отвечает, дальше игра пойдет без звука\n");
+            speech_broken = true;
+        }
+    }
+
+    pthread_mutex_unlock (&speech_lock);
+
+    return nullptr;
+}
+
+// blocks while the pipe is full, that is while festival is behind
+static bool SendUtterance (const char* text)
+{
+    uint64_t start = TraceBegin ();
+
+    char* path = CachePath (text);
+
+    bool cached = (access (path, R_OK) == 0);
+
+    if (cached)
+    {
+        // the newest files are the last to be deleted
+        utimensat (AT_FDCWD, path, nullptr, 0);
+
+        fputs ("(utt.play (utt.synth (Utterance Wave ", speech_pipe);
+        WriteString (path);
+        fputs (")))\n", speech_pipe);
+    }
+    else
+    {
+        fputs ("(set! akinator_utt (utt.synth (Utterance Text ", speech_pipe);
+        WriteString (text);
+        fputs (")))\n(utt.play akinator_utt)\n(utt.save.wave akinator_utt ", speech_pipe);
+        WriteString (path);
+        fputs (" 'riff)\n", speech_pipe);
+    }
+
+    free (path);
+
+    // festival saves the new file later, it is counted on the next trim
+    if (!cached) TrimCache ();
+
+    bool sent = (fflush (speech_pipe) == 0);
+
+    TraceEnd (TRACE_SPEAK, start);
+
+    return sent;
+}
+
+static char* CachePath (const char* text)
+{
+    size_t len  = strlen (speech_cache) + sizeof ("/0123456789abcdef.wav");
+    char*  path = (char*) calloc (len, sizeof (char));
+    assert (path);
+
+    snprintf (path, len, "%s/%016llx.wav", speech_cache,
+              (unsigned long long) NameHash (text, strlen (text)));
+
+    return path;
+}
+
+// deletes the files played longest ago until the cache fits into its size
+static void TrimCache ()
+{
+    DIR* dir = opendir (speech_cache);
+    if (!dir) return;
+
+    CacheFile* files    = nullptr;
+    size_t     count    = 0;
+    size_t     capacity = 0;
+    size_t     total    = 0;
+
+    int dir_fd = dirfd (dir);
+
+    for (dirent* entry = readdir (dir); entry; entry = readdir (dir))
+    {
+        size_t len = strlen (entry->d_name);
+        if (len >= sizeof (files->name) || len < 4 || strcmp (entry->d_name + len - 4, ".wav") != 0) continue;
+
+        struct stat info = {};
+        if (fstatat (dir_fd, entry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG (info.st_mode)) continue;
+
+        if (count == capacity)
+        {
+            capacity = 2 * capacity + 64;
+            files = (CacheFile*) realloc (files, capacity * sizeof (CacheFile));
+            assert (files);
+        }
+
+        memcpy (files[count].name, entry->d_name, len + 1);
+        files[count].played = info.st_mtime;
+        files[count].size   = (size_t) info.st_size;
+
+        total += files[count++].size;
+    }
+
+    if (total > speech_cache_size)
+    {
+        qsort (files, count, sizeof (CacheFile), CompareCacheFiles);
+
+        for (size_t i = 0; i < count && total > speech_cache_size; i++)
+        {
+            if (unlinkat (dir_fd, files[i].name, 0) == 0) total -= files[i].size;
+        }
+    }
+
+    closedir (dir);
+    free (files);
+}
+
+static int CompareCacheFiles (const void* file_1, const void* file_2)
+{
+    time_t played_1 = ((const CacheFile*) file_1)->played;
+    time_t played_2 = ((const CacheFile*) file_2)->played;
+
+    return (played_1 > played_2) - (played_1 < played_2);
+}
+
+// a Scheme string on one line, the text never reaches a shell
+static void WriteString (const char* str)
+{
+    fputc ('"', speech_pipe);
+
+    for ( ; *str; str++)
+    {
+        switch (*str)
+        {
+        case '"':
+        case '\\':
+            fputc ('\\', speech_pipe);
+            fputc (*str, speech_pipe);
+            break;
+        case '\n':
+        case '\r':
+        case '\t':
+            fputc (' ', speech_pipe);
+            break;
+        default:
+            fputc (*str, speech_pipe);
+            break;
+        }
+    }
+
+    fputc ('"', speech_pipe);
+}
+
+static bool IsBlank (const char* str)
+{
+    for ( ; *str; str++)
+    {
+        if (!strchr (" \t\r\n", *str)) return false;
+    }
+
+    return true;
+}
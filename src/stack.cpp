@@ -40,6 +40,7 @@ stack_errors stack_ctor(stack* stk ON_DEBUG(, function_info info))
     #endif
 
     #ifdef _HASH_PROTECTION
+        stk->hash_blocks = nullptr;
         HASH_PROTECTION_FUNCTION_CALL()
     #endif
 
@@ -65,7 +66,7 @@ stack_errors stack_push(stack* stk, elem_t value)
     stk->data[stk->size++] = value;
 
     #ifdef _HASH_PROTECTION
-        HASH_PROTECTION_FUNCTION_CALL()
+        HASH_PROTECTION_SLOT_CALL(stk->size - 1)
     #endif
 
     #ifdef _DEBUG
@@ -91,7 +92,7 @@ stack_errors stack_pop(stack* stk, elem_t* popped_value)
     stk->data[stk->size] = GARBAGE;
 
     #ifdef _HASH_PROTECTION
-        HASH_PROTECTION_FUNCTION_CALL()
+        HASH_PROTECTION_SLOT_CALL(stk->size)
     #endif
 
     #ifdef _DEBUG
@@ -105,7 +106,7 @@ stack_errors stack_pop(stack* stk, elem_t* popped_value)
 void stack_dtor(stack* stk)
 {
     #ifdef _DEBUG
-        stack_verify(stk);
+        stack_verify_full(stk);
     #endif
 
     stk->capacity = DTOR_GARBAGE;
@@ -122,8 +123,11 @@ void stack_dtor(stack* stk)
     #endif
 
     #ifdef _HASH_PROTECTION
-        stk->hash_struct = stk->hash_data = 0;
-        stk->hash_struct = poltorashka_hash((const char*) stk, sizeof(stack));
+        free(stk->hash_blocks);
+        stk->hash_blocks = nullptr;
+
+        stk->hash_data   = 0;
+        stk->hash_struct = stack_hash_struct(stk);
     #endif
 }
 
@@ -143,6 +147,14 @@ static void stack_recalloc_down(stack* stk)
 
 static elem_t* stack_recalloc(stack* stk, long long new_size, long long old_size)
 {
+    // the only place where the whole buffer is checked, amortized O(1) per operation
+    #ifdef _HASH_PROTECTION
+        long long capacity = stk->capacity;
+        stk->capacity = old_size;
+        stack_verify_full(stk);
+        stk->capacity = capacity;
+    #endif
+
     #ifdef _CANARY_PROTECTION
 
     memcpy(stk->left_canary_data,  &GARBAGE, sizeof(GARBAGE));
@@ -174,6 +186,10 @@ static elem_t* stack_recalloc(stack* stk, long long new_size, long long old_size
         fill_garbage(stk, new_size, old_size);
     }
 
+    #ifdef _HASH_PROTECTION
+        HASH_PROTECTION_FUNCTION_CALL()
+    #endif
+
     return stk->data;
 }
 
@@ -190,6 +206,73 @@ static void fill_garbage(stack* stk, long long new_size, long long old_size)
 
 #ifdef _HASH_PROTECTION
 
+long long stack_blocks_num(long long capacity)
+{
+    return (capacity + HASH_BLOCK - 1) / HASH_BLOCK;
+}
+
+// the struct hash covers hash_data, so the block hashes can not be swapped unnoticed
+long unsigned int stack_hash_struct(stack* stk)
+{
+    long unsigned int hash_struct_ref = stk->hash_struct;
+
+    stk->hash_struct = 0;
+    long unsigned int hash = poltorashka_hash((const char*) stk, sizeof(stack));
+    stk->hash_struct = hash_struct_ref;
+
+    return hash;
+}
+
+long unsigned int stack_hash_block(const stack* stk, long long block)
+{
+    long long begin = block * HASH_BLOCK;
+    long long end   = begin + HASH_BLOCK;
+    if (end > stk->capacity) end = stk->capacity;
+
+    return poltorashka_hash((const char*) (stk->data + begin), sizeof(elem_t) * (end - begin));
+}
+
+// binds a block hash to its position, so equal blocks do not cancel out in the sum
+long unsigned int stack_mix_block(long long block, long unsigned int hash)
+{
+    long unsigned int h = hash ^ ((long unsigned int) block * 0x9E3779B97F4A7C15UL);
+
+    h ^= h >> 29;
+    h *= 0x5bd1e995;
+    h ^= h >> 32;
+
+    return h;
+}
+
+void stack_rehash_all(stack* stk)
+{
+    long long blocks = stack_blocks_num(stk->capacity);
+
+    stk->hash_blocks = (long unsigned int*) realloc(stk->hash_blocks, blocks * sizeof(long unsigned int));
+    assert(stk->hash_blocks);
+
+    stk->hash_data = 0;
+
+    for (long long block = 0; block < blocks; block++)
+    {
+        stk->hash_blocks[block] = stack_hash_block(stk, block);
+        stk->hash_data += stack_mix_block(block, stk->hash_blocks[block]);
+    }
+
+    stk->hash_struct = stack_hash_struct(stk);
+}
+
+void stack_rehash_slot(stack* stk, long long index)
+{
+    long long block = index / HASH_BLOCK;
+
+    stk->hash_data -= stack_mix_block(block, stk->hash_blocks[block]);
+    stk->hash_blocks[block] = stack_hash_block(stk, block);
+    stk->hash_data += stack_mix_block(block, stk->hash_blocks[block]);
+
+    stk->hash_struct = stack_hash_struct(stk);
+}
+
 long unsigned int poltorashka_hash(const char* key, long unsigned int len)
 {
     const long unsigned int m = 0x5bd1e995;
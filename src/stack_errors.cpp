@@ -6,12 +6,25 @@
 #include "stack.h"
 #include "utils.h"
 
-static long long int find_stack_errors(stack* stk);
+static long long int find_stack_errors(stack* stk, bool full);
+static stack_errors check_stack(stack* stk, bool full);
 static void tell_error(stack* stk, long long int error_value);
 
+// checks the struct and the data blocks push and pop touch next
 stack_errors stack_verify(stack* stk)
 {
-    long long int errors = find_stack_errors(stk);
+    return check_stack(stk, false);
+}
+
+// checks every data block as well, O(capacity)
+stack_errors stack_verify_full(stack* stk)
+{
+    return check_stack(stk, true);
+}
+
+static stack_errors check_stack(stack* stk, bool full)
+{
+    long long int errors = find_stack_errors(stk, full);
     long long int error_value = 1;
 
     for (int num = 0; num < ERRORS_NUM; num++)
@@ -39,7 +52,7 @@ stack_errors stack_verify(stack* stk)
     return (stack_errors) error_value;
 }
 
-static long long int find_stack_errors(stack* stk)
+static long long int find_stack_errors(stack* stk, bool full)
 {
     long long int errors = 0;
 
@@ -64,24 +77,52 @@ static long long int find_stack_errors(stack* stk)
 
     #ifdef _HASH_PROTECTION
 
-    long unsigned int hash_struct_ref = stk->hash_struct;
-    long unsigned int hash_data_ref   = stk->hash_data;
+    if (stack_hash_struct(stk) != stk->hash_struct)
+    {
+        errors |= HASH_DETECTED_INVALID_CHANGES_STRUCT;
 
-    stk->hash_struct = stk->hash_data = 0;
-    stk->hash_struct = poltorashka_hash((const char*) stk, sizeof(stack));
+        return errors;
+    }
 
-    if (stk->hash_struct != hash_struct_ref)
+    if (stk->hash_blocks == nullptr || stk->size < 0 || stk->size > stk->capacity)
     {
-        errors |= HASH_DETECTED_INVALID_CHANGES_STRUCT;
+        errors |= HASH_DETECTED_INVALID_CHANGES_DATA;
 
         return errors;
     }
 
-    stk->hash_data = poltorashka_hash((const char*) stk->data, sizeof(elem_t) * stk->capacity);
+    long long blocks = stack_blocks_num(stk->capacity);
 
-    if (stk->hash_data != hash_data_ref)
+    if (full)
     {
-        errors |= HASH_DETECTED_INVALID_CHANGES_DATA;
+        long unsigned int hash_data = 0;
+
+        for (long long block = 0; block < blocks; block++)
+        {
+            if (stack_hash_block(stk, block) != stk->hash_blocks[block])
+            {
+                errors |= HASH_DETECTED_INVALID_CHANGES_DATA;
+            }
+
+            hash_data += stack_mix_block(block, stk->hash_blocks[block]);
+        }
+
+        if (hash_data != stk->hash_data) errors |= HASH_DETECTED_INVALID_CHANGES_DATA;
+    }
+    else
+    {
+        // the block of the top element and the one the next push writes to
+        long long first = (stk->size > 0) ? (stk->size - 1) / HASH_BLOCK : 0;
+        long long last  = stk->size / HASH_BLOCK;
+        if (last >= blocks) last = blocks - 1;
+
+        for (long long block = first; block <= last; block++)
+        {
+            if (stack_hash_block(stk, block) != stk->hash_blocks[block])
+            {
+                errors |= HASH_DETECTED_INVALID_CHANGES_DATA;
+            }
+        }
     }
 
     #endif
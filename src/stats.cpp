@@ -0,0 +1,428 @@
+#include "akinator.h"
+#include "journal.h"
+#include "stats.h"
+#include "utils.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+// One line per node that has been hit:
+//
+//   <way from the root, L and R> \t <reached> \t <yes> \t <no> \t <wrong> \t <questions> \n
+//
+// The root has an empty way. A way that leads nowhere in the current tree is
+// skipped, so a stats file written for an older base is still safe to load.
+// A leaf keeps the number of questions its games took: when it is split its
+// counters move one level down, and the games played before did not get longer.
+// A file without that column is from before it, its games are taken at the
+// depth the leaf has now.
+
+const char* const STATS_SUFFIX = ".stats";
+const size_t      STATS_HOTTEST = 10;
+const int         STATS_BAR     = 40;
+
+struct HotLeaf
+{
+    Node*    leaf;
+    uint64_t games;
+};
+
+static NodeStats* StatsOf    (Tree* tree, Node* node);
+static char*    StatsPath    (const char* base);
+static void     ApplyLine    (Tree* tree, char* line);
+static bool     WriteStats   (Tree* tree, FILE* file);
+static uint64_t Counter      (const Node* node, StatsEvent event);
+static uint64_t LeafGames    (const Node* node);
+static size_t   GameDepth    (const Node* node);
+static void     AddHotLeaf   (HotLeaf* hot, size_t* hot_num, Node* leaf, uint64_t games);
+static void     PrintHotLeaf (Tree* tree, HotLeaf* hot);
+static void     PrintDepths  (Tree* tree, uint64_t games);
+
+void StatsCount (Tree* tree, Node* node, StatsEvent event)
+{
+    assert (tree);
+    assert (node);
+
+    __atomic_fetch_add (&StatsOf (tree, node)->counters[event], 1, __ATOMIC_RELAXED);
+
+    tree->counted++;
+}
+
+// a guess, right or wrong, ends the game with as many questions as the leaf is deep
+void StatsCountGame (Tree* tree, Node* leaf, StatsEvent answer)
+{
+    assert (tree);
+    assert (leaf);
+    assert (answer == STATS_YES || answer == STATS_NO);
+
+    StatsCount (tree, leaf, answer);
+
+    __atomic_fetch_add (&StatsOf (tree, leaf)->counters[STATS_QUESTIONS], leaf->depth - tree->root->depth,
+                        __ATOMIC_RELAXED);
+}
+
+// every node from node up to stop, stop itself is not counted
+void StatsCountPath (Tree* tree, Node* node, Node* stop)
+{
+    assert (tree);
+
+    for ( ; node && node != stop; node = node->parent)
+    {
+        StatsCount (tree, node, STATS_REACHED);
+    }
+}
+
+bool StatsLoad (Tree* tree, const char* base)
+{
+    assert (tree);
+    assert (base);
+
+    if (is_special_file (base)) return false;
+
+    char* path = StatsPath (base);
+    FILE* file = fopen (path, "r");
+    free (path);
+
+    if (!file) return false;
+
+    char*  line     = nullptr;
+    size_t capacity = 0;
+
+    while (getline (&line, &capacity, file) >= 0)
+    {
+        ApplyLine (tree, line);
+    }
+
+    free (line);
+    fclose (file);
+
+    return true;
+}
+
+// the file is replaced as a whole and synced, so a crash leaves either the old stats or the new ones
+bool StatsSave (Tree* tree, const char* base)
+{
+    assert (tree);
+    assert (base);
+
+    if (is_special_file (base)) return false;
+
+    char* path = StatsPath (base);
+
+    size_t tmp_len  = strlen (path) + sizeof (".tmp");
+    char*  tmp_name = (char*) calloc (tmp_len, sizeof (char));
+    assert (tmp_name);
+    snprintf (tmp_name, tmp_len, "%s.tmp", path);
+
+    bool  saved = false;
+    FILE* file  = fopen (tmp_name, "w");
+
+    if (file)
+    {
+        saved = WriteStats (tree, file) && (fflush (file) == 0) && (fsync (fileno (file)) == 0);
+        saved = (fclose (file) == 0) && saved && (rename (tmp_name, path) == 0);
+        if (!saved) remove (tmp_name);
+
+        saved = saved && sync_parent_dir (path);
+    }
+
+    if (saved) tree->counted = 0;
+
+    free (tmp_name);
+    free (path);
+
+    return saved;
+}
+
+// saves the counters if something has been counted for STATS_SAVE_PERIOD seconds,
+// is called by the game loops between the games or input lines
+bool StatsSaveDue (Tree* tree, const char* base, time_t* saved_at)
+{
+    assert (tree);
+    assert (base);
+    assert (saved_at);
+
+    time_t now = time (nullptr);
+
+    if (tree->counted == 0 || now - *saved_at < STATS_SAVE_PERIOD) return true;
+
+    *saved_at = now;
+
+    return StatsSave (tree, base);
+}
+
+// the counters of a base whose tree has been rebuilt lead nowhere, they are dropped
+bool StatsRemove (const char* base)
+{
+    assert (base);
+
+    if (is_special_file (base)) return true;
+
+    char* path    = StatsPath (base);
+    bool  removed = remove (path) == 0 || errno == ENOENT;
+    free (path);
+
+    return removed;
+}
+
+// akinator --stats <base>
+int RunStats (const char* base)
+{
+    assert (base);
+
+    Tree tree = {};
+    if (!LoadTree (&tree, base))
+    {
+        fprintf (stderr, "Не удалось прочитать базу %s\n", base);
+        TreeDtor (&tree);
+        return 1;
+    }
+
+    JournalReplay (&tree, base);
+
+    PrintInternStats (stdout);
+    printf ("\n");
+
+    if (!StatsLoad (&tree, base))
+    {
+        printf ("Статистики по базе %s еще нет\n", base);
+        TreeDtor (&tree);
+        return 0;
+    }
+
+    HotLeaf  hot[STATS_HOTTEST] = {};
+    size_t   hot_num = 0;
+    uint64_t games   = 0, wrong = 0, depths = 0;
+
+    for (Node* node = tree.root; node; node = NextPreOrder (node, tree.root, SIZE_MAX, LEFT))
+    {
+        if (node->left || node->right) continue;
+
+        uint64_t leaf_games = LeafGames (node);
+        if (leaf_games == 0) continue;
+
+        games  += leaf_games;
+        wrong  += Counter (node, STATS_WRONG);
+        depths += Counter (node, STATS_QUESTIONS);
+
+        AddHotLeaf (hot, &hot_num, node, leaf_games);
+    }
+
+    printf ("Игр: %llu, из них выучено новых объектов: %llu\n",
+            (unsigned long long) games, (unsigned long long) wrong);
+
+    if (games == 0)
+    {
+        TreeDtor (&tree);
+        return 0;
+    }
+
+    printf ("Вопросов за игру в среднем: %.3f\n\n", (double) depths / (double) games);
+
+    printf ("Самые частые ответы:\n");
+    for (size_t i = 0; i < hot_num; i++) PrintHotLeaf (&tree, &hot[i]);
+
+    printf ("\nИгры по числу вопросов:\n");
+    PrintDepths (&tree, games);
+
+    TreeDtor (&tree);
+
+    return 0;
+}
+
+// Only the thread that changes the tree may call it: the counters are allocated from
+// the tree's arena. Readers on other threads see either nullptr or zeroed counters.
+static NodeStats* StatsOf (Tree* tree, Node* node)
+{
+    NodeStats* stats = __atomic_load_n (&node->stats, __ATOMIC_ACQUIRE);
+
+    if (!stats)
+    {
+        stats = (NodeStats*) arena_alloc (&tree->stats, sizeof (NodeStats), alignof (NodeStats));
+        *stats = {};
+
+        __atomic_store_n (&node->stats, stats, __ATOMIC_RELEASE);
+    }
+
+    return stats;
+}
+
+static char* StatsPath (const char* base)
+{
+    size_t len  = strlen (base) + strlen (STATS_SUFFIX) + 1;
+    char*  path = (char*) calloc (len, sizeof (char));
+    assert (path);
+
+    snprintf (path, len, "%s%s", base, STATS_SUFFIX);
+
+    return path;
+}
+
+static void ApplyLine (Tree* tree, char* line)
+{
+    Node* node = tree->root;
+    char* way  = line;
+
+    for ( ; *way == 'L' || *way == 'R'; way++)
+    {
+        node = (*way == 'L') ? node->left : node->right;
+        if (!node) return;
+    }
+
+    if (*way != '\t') return;
+
+    unsigned long long counters[STATS_EVENTS] = {};
+    int read = sscanf (way + 1, "%llu %llu %llu %llu %llu", &counters[STATS_REACHED], &counters[STATS_YES],
+                       &counters[STATS_NO], &counters[STATS_WRONG], &counters[STATS_QUESTIONS]);
+
+    if (read == STATS_QUESTIONS)
+        counters[STATS_QUESTIONS] = (counters[STATS_YES] + counters[STATS_NO]) * (node->depth - tree->root->depth);
+    else if (read != STATS_EVENTS)
+        return;
+
+    NodeStats* stats = StatsOf (tree, node);
+
+    for (int event = 0; event < STATS_EVENTS; event++)
+    {
+        __atomic_fetch_add (&stats->counters[event], (uint64_t) counters[event], __ATOMIC_RELAXED);
+    }
+}
+
+// pre-order walk that keeps the way to the current node in a growing buffer
+static bool WriteStats (Tree* tree, FILE* file)
+{
+    size_t capacity = 64;
+    char*  way      = (char*) calloc (capacity, sizeof (char));
+    assert (way);
+
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, LEFT))
+    {
+        size_t len = node->depth - tree->root->depth;
+
+        if (len > 0)
+        {
+            if (len > capacity)
+            {
+                capacity = 2 * len;
+                way = (char*) realloc (way, capacity);
+                assert (way);
+            }
+
+            way[len - 1] = (node == node->parent->left) ? 'L' : 'R';
+        }
+
+        if (!__atomic_load_n (&node->stats, __ATOMIC_ACQUIRE)) continue;
+
+        fprintf (file, "%.*s\t%llu\t%llu\t%llu\t%llu\t%llu\n", (int) len, way,
+                 (unsigned long long) Counter (node, STATS_REACHED),
+                 (unsigned long long) Counter (node, STATS_YES),
+                 (unsigned long long) Counter (node, STATS_NO),
+                 (unsigned long long) Counter (node, STATS_WRONG),
+                 (unsigned long long) Counter (node, STATS_QUESTIONS));
+    }
+
+    free (way);
+
+    return !ferror (file);
+}
+
+static uint64_t Counter (const Node* node, StatsEvent event)
+{
+    NodeStats* stats = __atomic_load_n (&node->stats, __ATOMIC_ACQUIRE);
+
+    return stats ? __atomic_load_n (&stats->counters[event], __ATOMIC_RELAXED) : 0;
+}
+
+// every game that got to a leaf ended with a guess, right or wrong
+static uint64_t LeafGames (const Node* node)
+{
+    return Counter (node, STATS_YES) + Counter (node, STATS_NO);
+}
+
+// the questions a game that ended at the leaf took, the leaf may have got deeper
+// since; the games from before and after a split go to the nearer depth
+static size_t GameDepth (const Node* node)
+{
+    uint64_t games = LeafGames (node);
+
+    return (size_t) ((Counter (node, STATS_QUESTIONS) + games / 2) / games);
+}
+
+// keeps the hottest leaves sorted by games, the coldest one is the last
+static void AddHotLeaf (HotLeaf* hot, size_t* hot_num, Node* leaf, uint64_t games)
+{
+    if (*hot_num == STATS_HOTTEST && hot[STATS_HOTTEST - 1].games >= games) return;
+
+    size_t i = (*hot_num < STATS_HOTTEST) ? (*hot_num)++ : STATS_HOTTEST - 1;
+
+    for ( ; i > 0 && hot[i - 1].games < games; i--) hot[i] = hot[i - 1];
+
+    hot[i] = {leaf, games};
+}
+
+static void PrintHotLeaf (Tree* tree, HotLeaf* hot)
+{
+    printf ("%8llu игр, %llu ошибок: ", (unsigned long long) hot->games,
+            (unsigned long long) Counter (hot->leaf, STATS_WRONG));
+
+    PathStack path;
+    FindPath (hot->leaf, &path);
+
+    for (Node* node = tree->root; !path.empty (); )
+    {
+        if (path.pop () == LEFT)
+        {
+            printf ("%.*s - да, ", NODE_NAME (node));
+            node = node->left;
+        }
+        else
+        {
+            printf ("%.*s - нет, ", NODE_NAME (node));
+            node = node->right;
+        }
+    }
+
+    printf ("%.*s\n", NODE_NAME (hot->leaf));
+}
+
+static void PrintDepths (Tree* tree, uint64_t games)
+{
+    size_t max_depth = 0;
+
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, LEFT))
+    {
+        if (!node->left && !node->right && LeafGames (node) > 0 && GameDepth (node) > max_depth)
+            max_depth = GameDepth (node);
+    }
+
+    size_t    depths_num = max_depth + 1;
+    uint64_t* depths     = (uint64_t*) calloc (depths_num, sizeof (uint64_t));
+    assert (depths);
+
+    uint64_t most = 0;
+
+    for (Node* node = tree->root; node; node = NextPreOrder (node, tree->root, SIZE_MAX, LEFT))
+    {
+        if (node->left || node->right || LeafGames (node) == 0) continue;
+
+        size_t depth = GameDepth (node);
+
+        depths[depth] += LeafGames (node);
+        if (depths[depth] > most) most = depths[depth];
+    }
+
+    for (size_t depth = 0; depth < depths_num; depth++)
+    {
+        if (depths[depth] == 0) continue;
+
+        int bar = (int) ((depths[depth] * STATS_BAR + most - 1) / most);
+
+        printf ("%8zu %10llu %6.2f%% %.*s\n", depth, (unsigned long long) depths[depth],
+                100.0 * (double) depths[depth] / (double) games, bar,
+                "########################################");
+    }
+
+    free (depths);
+}
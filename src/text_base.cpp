@@ -0,0 +1,765 @@
+#include "akinator.h"
+#include "scanner.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <thread>
+
+// The text base is parsed from its structural index (see scanner.h).
+//
+// A large base is parsed in parallel. The top of the tree is built on one thread,
+// and every subtree with few enough structural characters is left to the workers
+// as a task. Each worker builds its subtrees in an arena of its own, which is handed
+// over to the tree at the end. The leaves are then indexed by all threads at once,
+// and of the leaves with one name the index is left with the first in pre-order,
+// the same one the serial loader keeps.
+//
+// A large tree is saved in parallel the same way: the subtrees at some depth are
+// formatted by the workers into buffers of their own, while the main thread writes
+// the top of the tree and copies the finished subtrees out in order.
+
+const size_t PARALLEL_LOAD_MIN_SIZE = 16 * 1024 * 1024;
+const size_t PARALLEL_SAVE_MIN_SIZE = 16 * 1024 * 1024;    // of the nodes arena
+const size_t TASKS_PER_THREAD       = 16;
+const size_t MAX_SAVE_SPLIT_DEPTH   = 32;
+const size_t WRITER_BUFFER_SIZE     = 1 << 20;
+
+struct LoadTask
+{
+    Node*  node;    // linked to its parent already, the name is parsed by the worker
+    size_t mark;    // the '(' of the node
+};
+
+struct TextLoader
+{
+    arena*            nodes;
+    const char*       buffer;
+    const scan_index* index;
+    size_t            leaves;
+
+    // set only while the top of a tree is built for the workers
+    const size_t* close;      // the matching ')' of every '('
+    size_t        grain;      // subtrees of at most so many marks become tasks
+    LoadTask*     tasks;
+    size_t        tasks_num;
+    size_t        tasks_capacity;
+    Node**        top_leaves; // the leaves outside of the tasks
+    size_t        top_leaves_num;
+    size_t        top_leaves_capacity;
+
+    // the leaves that have found their name already taken while the tasks were indexed
+    Node**        duplicates;
+    size_t        duplicates_num;
+    size_t        duplicates_capacity;
+};
+
+// output is collected in big chunks, a writer without a file just keeps growing
+struct TextWriter
+{
+    FILE*  file;
+    char*  data;
+    size_t size;
+    size_t capacity;
+};
+
+enum SaveTaskState
+{
+    SAVE_TASK_FREE,
+    SAVE_TASK_TAKEN,
+    SAVE_TASK_DONE
+};
+
+struct SaveTask
+{
+    Node*            node;
+    std::atomic<int> state;
+    TextWriter       text;
+};
+
+struct SavePool
+{
+    const Snapshot*     snapshot;
+    SaveTask*           tasks;
+    size_t              tasks_num;
+    size_t              written;     // tasks the main thread has got to
+    int                 level;       // of the task subtrees
+    std::atomic<size_t> next_task;
+};
+
+struct LoadPool
+{
+    Tree*               tree;
+    TextLoader*         top;
+    TextLoader*         workers;
+    arena*              arenas;    // nodes of every worker
+    std::atomic<size_t> next_task;
+};
+
+static bool    GetTreeParallel (Tree* tree, const char* buffer, const scan_index* index, size_t threads);
+static size_t  BuildSubtree    (TextLoader* loader, Node* node, size_t mark);
+static void    AddTask         (TextLoader* loader, Node* node, size_t mark);
+static void    AddLeaf         (TextLoader* loader, Node* leaf);
+static size_t* MatchParens     (const char* buffer, const scan_index* index);
+static void    BuildTasks      (LoadPool* pool, size_t worker);
+static void    IndexTasks      (LoadPool* pool, size_t worker);
+static void    AddDuplicate    (TextLoader* loader, Node* leaf);
+static void    KeepFirstLeaves (Tree* tree, Node** duplicates, size_t duplicates_num);
+static int     ComparePreOrder (const void* node_1, const void* node_2);
+static size_t  RootMark        (const char* buffer, const scan_index* index, size_t* start);
+static void    GetName         (TextLoader* loader, Node* node, size_t from, size_t to);
+static size_t  MarkPos         (const scan_index* index, size_t mark);
+static bool    IsNameSpace     (char ch);
+static size_t  TextThreads     ();
+
+static void    WriteTree       (TextWriter* out, const Snapshot* snapshot, Node* node, int level, SavePool* pool);
+static void    WriteTask       (TextWriter* out, SavePool* pool);
+static void    SaveTasks       (SavePool* pool);
+static size_t  SplitSaveDepth  (const Snapshot* snapshot, Node* root, size_t tasks);
+static void    WriteLine       (TextWriter* out, int level, const char* str, size_t len);
+static void    WriterPut       (TextWriter* out, const char* str, size_t len);
+static void    WriterFlush     (TextWriter* out);
+
+// builds the tree of the text base and indexes its leaves
+bool GetTreeText (Tree* tree, const char* buffer, size_t size)
+{
+    assert (tree);
+    assert (buffer);
+
+    if (size == 0)
+    {
+        BuildIndex (tree);
+        return true;
+    }
+
+    size_t threads = (size >= PARALLEL_LOAD_MIN_SIZE) ? TextThreads () : 1;
+
+    scan_index index = {};
+    if (!scan_build (&index, buffer, size, threads)) return false;
+
+    bool loaded = true;
+
+    if (threads > 1)
+    {
+        loaded = GetTreeParallel (tree, buffer, &index, threads);
+    }
+    else
+    {
+        TextLoader loader = {&tree->nodes, buffer, &index};
+
+        size_t start = 0;
+        size_t mark  = RootMark (buffer, &index, &start);
+
+        GetName (&loader, tree->root, start, MarkPos (&index, mark));
+        BuildSubtree (&loader, tree->root, mark);
+
+        BuildIndex (tree);
+    }
+
+    scan_dtor (&index);
+
+    return loaded;
+}
+
+static bool GetTreeParallel (Tree* tree, const char* buffer, const scan_index* index, size_t threads)
+{
+    size_t* close = MatchParens (buffer, index);
+    if (!close) return false;
+
+    TextLoader top = {&tree->nodes, buffer, index};
+    top.close = close;
+    top.grain = index->size / (threads * TASKS_PER_THREAD) + 1;
+
+    size_t start = 0;
+    size_t mark  = RootMark (buffer, index, &start);
+
+    GetName (&top, tree->root, start, MarkPos (index, mark));
+    BuildSubtree (&top, tree->root, mark);
+
+    LoadPool pool = {};
+    pool.tree    = tree;
+    pool.top     = &top;
+    pool.workers = (TextLoader*) calloc (threads, sizeof (TextLoader));
+    pool.arenas  = (arena*)      calloc (threads, sizeof (arena));
+    assert (pool.workers);
+    assert (pool.arenas);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        arena_ctor (&pool.arenas[i], tree->nodes.slab_size);
+
+        pool.workers[i] = {&pool.arenas[i], buffer, index};
+    }
+
+    std::thread* workers = new std::thread[threads];
+
+    pool.next_task = 0;
+    for (size_t i = 0; i < threads; i++) workers[i] = std::thread (BuildTasks, &pool, i);
+    for (size_t i = 0; i < threads; i++) workers[i].join ();
+
+    size_t leaves = top.top_leaves_num;
+    for (size_t i = 0; i < threads; i++)
+    {
+        leaves += pool.workers[i].leaves;
+
+        arena_merge (&tree->nodes, pool.workers[i].nodes);
+    }
+
+    IndexReserve (&tree->index, leaves);
+
+    pool.next_task = 0;
+    for (size_t i = 0; i < threads; i++) workers[i] = std::thread (IndexTasks, &pool, i);
+    for (size_t i = 0; i < threads; i++) workers[i].join ();
+
+    for (size_t i = 0; i < top.top_leaves_num; i++)
+    {
+        if (!IndexInsertShared (&tree->index, top.top_leaves[i])) AddDuplicate (&top, top.top_leaves[i]);
+    }
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        for (size_t j = 0; j < pool.workers[i].duplicates_num; j++) AddDuplicate (&top, pool.workers[i].duplicates[j]);
+
+        free (pool.workers[i].duplicates);
+    }
+
+    KeepFirstLeaves (tree, top.duplicates, top.duplicates_num);
+
+    delete[] workers;
+
+    free (pool.arenas);
+    free (pool.workers);
+    free (top.tasks);
+    free (top.top_leaves);
+    free (top.duplicates);
+    free (close);
+
+    return true;
+}
+
+// Builds the subtree of node from the first mark after its name up to its ')'.
+// node is the innermost open subtree, '(' opens its next child and ')' goes back
+// to the parent. Returns the mark where it has stopped.
+static size_t BuildSubtree (TextLoader* loader, Node* node, size_t mark)
+{
+    const scan_index* index  = loader->index;
+    const char*       buffer = loader->buffer;
+
+    Node*  root    = node;
+    size_t skipped = 0;    // depth inside a subtree that does not fit anywhere
+
+    for (; mark < index->size; mark++)
+    {
+        size_t pos = index->marks[mark];
+
+        if (buffer[pos] == '(')
+        {
+            if (skipped > 0 || (node->right && node->left))
+            {
+                skipped++;
+                continue;
+            }
+
+            Node* child = CreateNodeIn (loader->nodes, node, node->right ? LEFT : RIGHT);
+
+            // the whole subtree is left to a worker, which also parses the name
+            if (loader->close && loader->close[mark] < index->size &&
+                loader->close[mark] - mark <= loader->grain)
+            {
+                AddTask (loader, child, mark);
+                mark = loader->close[mark];
+                continue;
+            }
+
+            node = child;
+            GetName (loader, node, pos + 1, MarkPos (index, mark + 1));
+        }
+        else if (buffer[pos] == ')')
+        {
+            if (skipped > 0)
+            {
+                skipped--;
+                continue;
+            }
+
+            if (!node->right)
+            {
+                AddLeaf (loader, node);
+            }
+            else if (!node->left)
+            {
+                // a question always has both answers
+                AddLeaf (loader, CreateNodeIn (loader->nodes, node, LEFT));
+            }
+
+            if (node == root) break;
+
+            node = node->parent;
+        }
+    }
+
+    // the base has ended before the subtree was closed
+    if (mark == index->size && !node->right) AddLeaf (loader, node);
+
+    return mark;
+}
+
+static void AddTask (TextLoader* loader, Node* node, size_t mark)
+{
+    if (loader->tasks_num == loader->tasks_capacity)
+    {
+        loader->tasks_capacity = 2 * loader->tasks_capacity + 64;
+        loader->tasks = (LoadTask*) realloc (loader->tasks, loader->tasks_capacity * sizeof (LoadTask));
+        assert (loader->tasks);
+    }
+
+    loader->tasks[loader->tasks_num++] = {node, mark};
+}
+
+// counts a leaf, the top of a parallel load also keeps it for the index
+static void AddLeaf (TextLoader* loader, Node* leaf)
+{
+    loader->leaves++;
+
+    if (!loader->close) return;
+
+    if (loader->top_leaves_num == loader->top_leaves_capacity)
+    {
+        loader->top_leaves_capacity = 2 * loader->top_leaves_capacity + 64;
+        loader->top_leaves = (Node**) realloc (loader->top_leaves, loader->top_leaves_capacity * sizeof (Node*));
+        assert (loader->top_leaves);
+    }
+
+    loader->top_leaves[loader->top_leaves_num++] = leaf;
+}
+
+// for every '(' the mark of its ')', index->size if it is never closed
+static size_t* MatchParens (const char* buffer, const scan_index* index)
+{
+    size_t* close = (size_t*) calloc (index->size + 1, sizeof (size_t));
+    size_t* open  = (size_t*) calloc (index->size + 1, sizeof (size_t));
+
+    if (!close || !open)
+    {
+        free (close);
+        free (open);
+        return nullptr;
+    }
+
+    size_t depth = 0;
+
+    for (size_t mark = 0; mark < index->size; mark++)
+    {
+        char ch = buffer[index->marks[mark]];
+
+        if (ch == '(')
+        {
+            close[mark]   = index->size;
+            open[depth++] = mark;
+        }
+        else if (ch == ')' && depth > 0)
+        {
+            close[open[--depth]] = mark;
+        }
+    }
+
+    free (open);
+
+    return close;
+}
+
+// tasks are taken one by one, so a thread that got small subtrees just takes more
+static void BuildTasks (LoadPool* pool, size_t worker)
+{
+    TextLoader* loader = &pool->workers[worker];
+    TextLoader* top    = pool->top;
+
+    for (size_t task = pool->next_task++; task < top->tasks_num; task = pool->next_task++)
+    {
+        Node*  node = top->tasks[task].node;
+        size_t mark = top->tasks[task].mark;
+
+        GetName (loader, node, loader->index->marks[mark] + 1, MarkPos (loader->index, mark + 1));
+        BuildSubtree (loader, node, mark + 1);
+    }
+}
+
+static void IndexTasks (LoadPool* pool, size_t worker)
+{
+    TextLoader* loader = &pool->workers[worker];
+    TextLoader* top    = pool->top;
+
+    for (size_t task = pool->next_task++; task < top->tasks_num; task = pool->next_task++)
+    {
+        Node* root = top->tasks[task].node;
+
+        for (Node* node = root; node; node = NextPreOrder (node, root, SIZE_MAX, RIGHT))
+        {
+            if (node->left || node->right || IndexInsertShared (&pool->tree->index, node)) continue;
+
+            AddDuplicate (loader, node);
+        }
+    }
+}
+
+static void AddDuplicate (TextLoader* loader, Node* leaf)
+{
+    if (loader->duplicates_num == loader->duplicates_capacity)
+    {
+        loader->duplicates_capacity = 2 * loader->duplicates_capacity + 16;
+        loader->duplicates = (Node**) realloc (loader->duplicates, loader->duplicates_capacity * sizeof (Node*));
+        assert (loader->duplicates);
+    }
+
+    loader->duplicates[loader->duplicates_num++] = leaf;
+}
+
+// Whichever thread has come first has kept a name. Every duplicate that is earlier
+// in pre-order takes the slot over and the leaf it pushes out becomes a duplicate
+// itself, so in the end the first leaf of every name has the slot. The duplicates
+// are then reported in pre-order, as the serial loader reports them.
+static void KeepFirstLeaves (Tree* tree, Node** duplicates, size_t duplicates_num)
+{
+    for (size_t i = 0; i < duplicates_num; i++)
+    {
+        Node* kept = IndexFindName (&tree->index, duplicates[i]->name);
+
+        if (ComparePreOrder (&duplicates[i], &kept) > 0) continue;
+
+        IndexReplace (&tree->index, kept, duplicates[i]);
+        duplicates[i] = kept;
+    }
+
+    qsort (duplicates, duplicates_num, sizeof (Node*), ComparePreOrder);
+
+    for (size_t i = 0; i < duplicates_num; i++)
+    {
+        fprintf (stderr, "Объект %.*s встречается в базе несколько раз\n", NODE_NAME (duplicates[i]));
+    }
+}
+
+// two leaves in pre-order with the right child first, by the sides of their common ancestor
+static int ComparePreOrder (const void* node_1, const void* node_2)
+{
+    Node* leaf_1 = *(Node* const*) node_1;
+    Node* leaf_2 = *(Node* const*) node_2;
+
+    if (leaf_1 == leaf_2) return 0;
+
+    Node* child_1 = nullptr;
+    Node* child_2 = nullptr;
+    Node* common  = CommonAncestor (leaf_1, leaf_2, &child_1, &child_2);
+
+    return (child_1 == common->right) ? -1 : 1;
+}
+
+// the root name starts after the first '(', returns the first mark after that
+static size_t RootMark (const char* buffer, const scan_index* index, size_t* start)
+{
+    *start = scan_skip_blanks (index, 0, index->length);
+    if (*start < index->length && buffer[*start] == '(') (*start)++;
+
+    size_t mark = 0;
+    while (mark < index->size && index->marks[mark] < *start) mark++;
+
+    return mark;
+}
+
+// the position of the mark-th structural character, the end of the buffer after the last one
+static size_t MarkPos (const scan_index* index, size_t mark)
+{
+    return (mark < index->size) ? index->marks[mark] : index->length;
+}
+
+// A name is the text between two structural characters without the whitespace
+// around it, whitespace other than ' ' inside it is dropped. Usually there is none,
+// then the name is interned straight from the buffer, otherwise from a cleaned copy.
+static void GetName (TextLoader* loader, Node* node, size_t from, size_t to)
+{
+    assert (loader);
+    assert (node);
+
+    const char*       buffer = loader->buffer;
+    const scan_index* index  = loader->index;
+
+    size_t first  = scan_skip_blanks  (index, from, to);
+    size_t last   = scan_trim_blanks  (index, first, to);
+    size_t breaks = scan_count_breaks (index, first, last);
+
+    size_t len = last - first - breaks;
+
+    if (breaks == 0)
+    {
+        node->name = InternName (buffer + first, len);
+        return;
+    }
+
+    char* name = (char*) calloc (len + 1, sizeof (char));
+    assert (name);
+
+    for (size_t i = 0; first < last; first++)
+    {
+        if (!IsNameSpace (buffer[first])) name[i++] = buffer[first];
+    }
+
+    node->name = InternName (name, len);
+
+    free (name);
+}
+
+static bool IsNameSpace (char ch)
+{
+    return isspace (ch) && ch != ' ';
+}
+
+// AKINATOR_THREADS overrides the number of cores
+static size_t TextThreads ()
+{
+    const char* env = getenv ("AKINATOR_THREADS");
+    if (env && atoi (env) > 0) return (size_t) atoi (env);
+
+    size_t cores = std::thread::hardware_concurrency ();
+
+    return (cores > 0) ? cores : 1;
+}
+
+// the tree is saved on several threads once it is big enough
+void PrintTreeText (const Snapshot* snapshot, FILE* file)
+{
+    assert (snapshot);
+    assert (file);
+
+    size_t threads = (snapshot->size >= PARALLEL_SAVE_MIN_SIZE) ? TextThreads () : 1;
+
+    if (threads > 1)
+        PrintTreeParallel (snapshot, snapshot->root, file, threads);
+    else
+        PrintTree (snapshot, snapshot->root, file, 0);
+}
+
+void PrintTree (const Snapshot* snapshot, Node* node, FILE* file, int level)
+{
+    assert (snapshot);
+    assert (node);
+    assert (file);
+
+    TextWriter out = {file};
+
+    WriteTree (&out, snapshot, node, level, nullptr);
+
+    WriterFlush (&out);
+    free (out.data);
+}
+
+void PrintTreeParallel (const Snapshot* snapshot, Node* node, FILE* file, size_t threads)
+{
+    assert (snapshot);
+    assert (node);
+    assert (file);
+
+    size_t depth = SplitSaveDepth (snapshot, node, threads * TASKS_PER_THREAD);
+
+    SavePool pool = {};
+    pool.snapshot = snapshot;
+    pool.level    = (int) depth;
+
+    for (Node* cur = node; cur; cur = NextPreOrderIn (snapshot, cur, node, depth, RIGHT))
+    {
+        if (cur->depth - node->depth == depth) pool.tasks_num++;
+    }
+
+    if (depth == 0 || pool.tasks_num < 2)
+    {
+        PrintTree (snapshot, node, file, 0);
+        return;
+    }
+
+    pool.tasks = new SaveTask[pool.tasks_num];
+
+    size_t task = 0;
+    for (Node* cur = node; cur; cur = NextPreOrderIn (snapshot, cur, node, depth, RIGHT))
+    {
+        if (cur->depth - node->depth != depth) continue;
+
+        pool.tasks[task].node  = cur;
+        pool.tasks[task].state = SAVE_TASK_FREE;
+        pool.tasks[task].text  = {};
+        task++;
+    }
+
+    // the main thread is one of the workers too, it formats every subtree nobody has taken
+    std::thread* workers = new std::thread[threads - 1];
+    for (size_t i = 0; i < threads - 1; i++) workers[i] = std::thread (SaveTasks, &pool);
+
+    TextWriter out = {file};
+
+    WriteTree (&out, snapshot, node, 0, &pool);
+    WriterFlush (&out);
+
+    for (size_t i = 0; i < threads - 1; i++) workers[i].join ();
+
+    free (out.data);
+    delete[] workers;
+    delete[] pool.tasks;
+}
+
+// Pre-order walk along the parent pointers: a subtree is closed when the walk
+// climbs out of it. With a pool the subtrees at pool->level are not walked,
+// they are taken from the pool in the same order.
+static void WriteTree (TextWriter* out, const Snapshot* snapshot, Node* node, int level, SavePool* pool)
+{
+    Node* cur   = node;
+    int   start = level;
+
+    while (true)
+    {
+        if (pool && level - start == pool->level)
+        {
+            WriteTask (out, pool);
+        }
+        else
+        {
+            NodeView view = ViewNode (snapshot, cur);
+
+            WriteLine (out, level, "(", 1);
+            WriteLine (out, level, NameText (view.name), NameLength (view.name));
+
+            if (view.right || view.left)
+            {
+                cur = view.right ? view.right : view.left;
+                level++;
+                continue;
+            }
+
+            WriteLine (out, level, ")", 1);
+        }
+
+        while (true)
+        {
+            if (cur == node) return;
+
+            Node* parent = cur->parent;    // had its children before cur was reached
+            level--;
+
+            if (cur == parent->right && parent->left)
+            {
+                cur = parent->left;
+                level++;
+                break;
+            }
+
+            cur = parent;
+            WriteLine (out, level, ")", 1);
+        }
+    }
+}
+
+// the next subtree in order: formatted right into the output if nobody has taken it yet
+static void WriteTask (TextWriter* out, SavePool* pool)
+{
+    SaveTask* task = &pool->tasks[pool->written++];
+
+    int state = SAVE_TASK_FREE;
+    if (task->state.compare_exchange_strong (state, SAVE_TASK_TAKEN))
+    {
+        WriteTree (out, pool->snapshot, task->node, pool->level, nullptr);
+        return;
+    }
+
+    while (task->state.load (std::memory_order_acquire) != SAVE_TASK_DONE) std::this_thread::yield ();
+
+    WriterPut (out, task->text.data, task->text.size);
+
+    free (task->text.data);
+    task->text = {};
+}
+
+static void SaveTasks (SavePool* pool)
+{
+    for (size_t i = pool->next_task++; i < pool->tasks_num; i = pool->next_task++)
+    {
+        SaveTask* task  = &pool->tasks[i];
+        int       state = SAVE_TASK_FREE;
+
+        if (!task->state.compare_exchange_strong (state, SAVE_TASK_TAKEN)) continue;
+
+        WriteTree (&task->text, pool->snapshot, task->node, pool->level, nullptr);
+
+        task->state.store (SAVE_TASK_DONE, std::memory_order_release);
+    }
+}
+
+// the first depth with enough subtrees for the tasks, 0 if there is none
+static size_t SplitSaveDepth (const Snapshot* snapshot, Node* root, size_t tasks)
+{
+    for (size_t depth = 1; depth <= MAX_SAVE_SPLIT_DEPTH; depth++)
+    {
+        size_t count = 0;
+
+        for (Node* cur = root; cur && count < tasks; cur = NextPreOrderIn (snapshot, cur, root, depth, RIGHT))
+        {
+            if (cur->depth - root->depth == depth) count++;
+        }
+
+        if (count >= tasks) return depth;
+    }
+
+    return 0;
+}
+
+// The indent stops growing at 64 tabs: a chain of questions indented in full
+// would make the base quadratic in its depth. The loader skips any indent.
+static void WriteLine (TextWriter* out, int level, const char* str, size_t len)
+{
+    static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"
+                               "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+    const size_t tabs_len = sizeof (tabs) - 1;
+
+    size_t indent = ((size_t) level < tabs_len) ? (size_t) level : tabs_len;
+    if (indent > 0) WriterPut (out, tabs, indent);
+
+    WriterPut (out, str, len);
+    WriterPut (out, "\n", 1);
+}
+
+static void WriterPut (TextWriter* out, const char* str, size_t len)
+{
+    if (out->size + len > out->capacity)
+    {
+        size_t capacity = 0;
+
+        if (out->file)
+        {
+            WriterFlush (out);
+
+            if (len > WRITER_BUFFER_SIZE)
+            {
+                fwrite (str, sizeof (char), len, out->file);
+                return;
+            }
+
+            capacity = WRITER_BUFFER_SIZE;
+        }
+        else
+        {
+            capacity = 2 * out->capacity + len;
+        }
+
+        if (capacity > out->capacity)
+        {
+            out->data = (char*) realloc (out->data, capacity);
+            assert (out->data);
+            out->capacity = capacity;
+        }
+    }
+
+    memcpy (out->data + out->size, str, len);
+    out->size += len;
+}
+
+static void WriterFlush (TextWriter* out)
+{
+    if (out->size > 0) fwrite (out->data, sizeof (char), out->size, out->file);
+
+    out->size = 0;
+}
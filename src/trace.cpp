@@ -0,0 +1,248 @@
+#include "trace.h"
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Histograms are log-linear: values below 8 ns get a bucket each, every power of
+// two above is split into 8 buckets, so a percentile is off by at most 1/8 of it.
+// Counters are bumped with relaxed atomics, the loader threads may time the same
+// phase at once.
+
+const int    TRACE_SUB_BITS = 3;
+const int    TRACE_SUB      = 1 << TRACE_SUB_BITS;
+const size_t TRACE_BUCKETS  = (64 - TRACE_SUB_BITS + 1) * TRACE_SUB;
+
+struct TraceHistogram
+{
+    uint64_t buckets[TRACE_BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+static const char* const trace_names[TRACE_PHASES] =
+{
+    "read", "parse", "lookup", "path", "compare", "serialize", "dump", "dot", "speak"
+};
+
+static TraceHistogram trace_phases[TRACE_PHASES] = {};
+
+static bool     trace_enabled    = false;
+static bool     trace_histograms = false;
+static uint64_t trace_origin     = 0;
+
+static FILE*           trace_json       = nullptr;
+static bool            trace_json_first = true;
+static pthread_mutex_t trace_json_lock  = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile sig_atomic_t trace_dump_requested = 0;
+
+static uint64_t Now            ();
+static size_t   TraceBucket    (uint64_t ns);
+static uint64_t BucketTop      (size_t bucket);
+static uint64_t Percentile     (const TraceHistogram* histogram, uint64_t count, double share);
+static void     TraceDump      (FILE* file);
+static void     TraceFinish    ();
+static void     RequestDump    (int signal);
+static void     WriteEvent     (TracePhase phase, uint64_t start, uint64_t end);
+
+// called once from main before any thread is started
+void TraceInit ()
+{
+    const char* histograms = getenv ("AKINATOR_TRACE");
+    const char* json       = getenv ("AKINATOR_TRACE_JSON");
+
+    trace_histograms = histograms && *histograms && strcmp (histograms, "0") != 0;
+
+    if (json && *json)
+    {
+        trace_json = fopen (json, "w");
+
+        if (trace_json)
+            fputs ("{\"traceEvents\":[\n", trace_json);
+        else
+            fprintf (stderr, "Не удалось открыть файл трассировки %s\n", json);
+    }
+
+    trace_enabled = trace_histograms || trace_json;
+    if (!trace_enabled) return;
+
+    trace_origin = Now ();
+
+    signal (SIGUSR1, RequestDump);
+    atexit (TraceFinish);
+}
+
+uint64_t TraceBegin ()
+{
+    return trace_enabled ? Now () : 0;
+}
+
+void TraceEnd (TracePhase phase, uint64_t start)
+{
+    if (start == 0) return;
+
+    TraceSpan (phase, start, Now ());
+}
+
+// for phases that were timed somewhere else, like a child process
+void TraceSpan (TracePhase phase, uint64_t start, uint64_t end)
+{
+    assert (phase < TRACE_PHASES);
+
+    if (start == 0 || end < start) return;
+
+    uint64_t        ns        = end - start;
+    TraceHistogram* histogram = &trace_phases[phase];
+
+    __atomic_fetch_add (&histogram->buckets[TraceBucket (ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&histogram->count, 1,  __ATOMIC_RELAXED);
+    __atomic_fetch_add (&histogram->total, ns, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n (&histogram->max, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n (&histogram->max, &max, ns, true,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+
+    if (trace_json) WriteEvent (phase, start, end);
+
+    TracePoll ();
+}
+
+// the signal handler only sets a flag, the dump is made by the next timed call
+// or by a loop that polls
+void TracePoll ()
+{
+    if (!trace_dump_requested) return;
+
+    trace_dump_requested = 0;
+
+    TraceDump (stderr);
+}
+
+static uint64_t Now ()
+{
+    timespec now = {};
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+static size_t TraceBucket (uint64_t ns)
+{
+    if (ns < (uint64_t) TRACE_SUB) return (size_t) ns;
+
+    int power = 63 - __builtin_clzll (ns);
+    int shift = power - TRACE_SUB_BITS;
+
+    return (size_t) (shift + 1) * TRACE_SUB + (size_t) ((ns >> shift) & (TRACE_SUB - 1));
+}
+
+// the largest value that falls into the bucket
+static uint64_t BucketTop (size_t bucket)
+{
+    if (bucket < (size_t) TRACE_SUB) return bucket;
+
+    int      shift = (int) (bucket / TRACE_SUB) - 1;
+    uint64_t sub   = bucket % TRACE_SUB;
+
+    return ((TRACE_SUB + sub + 1) << shift) - 1;
+}
+
+static uint64_t Percentile (const TraceHistogram* histogram, uint64_t count, double share)
+{
+    uint64_t rank = (uint64_t) (share * (double) count);
+    if (rank < count) rank++;
+
+    uint64_t max  = __atomic_load_n (&histogram->max, __ATOMIC_RELAXED);
+    uint64_t seen = 0;
+
+    for (size_t bucket = 0; bucket < TRACE_BUCKETS; bucket++)
+    {
+        seen += __atomic_load_n (&histogram->buckets[bucket], __ATOMIC_RELAXED);
+
+        if (seen >= rank) return (BucketTop (bucket) < max) ? BucketTop (bucket) : max;
+    }
+
+    return max;
+}
+
+static void TraceDump (FILE* file)
+{
+    if (trace_histograms)
+    {
+        // printf pads by bytes, and the Cyrillic letters take two of them
+        fputs ("фаза          вызовов          p50          p99          max          всего   (мкс)\n", file);
+
+        for (int phase = 0; phase < TRACE_PHASES; phase++)
+        {
+            const TraceHistogram* histogram = &trace_phases[phase];
+
+            uint64_t count = __atomic_load_n (&histogram->count, __ATOMIC_RELAXED);
+            if (count == 0) continue;
+
+            fprintf (file, "%-10s %10llu %12.1f %12.1f %12.1f %14.1f\n", trace_names[phase],
+                     (unsigned long long) count,
+                     (double) Percentile (histogram, count, 0.50) / 1000,
+                     (double) Percentile (histogram, count, 0.99) / 1000,
+                     (double) __atomic_load_n (&histogram->max,   __ATOMIC_RELAXED) / 1000,
+                     (double) __atomic_load_n (&histogram->total, __ATOMIC_RELAXED) / 1000);
+        }
+    }
+
+    if (trace_json)
+    {
+        pthread_mutex_lock (&trace_json_lock);
+        fflush (trace_json);
+        pthread_mutex_unlock (&trace_json_lock);
+    }
+}
+
+static void TraceFinish ()
+{
+    TraceDump (stderr);
+
+    if (!trace_json) return;
+
+    pthread_mutex_lock (&trace_json_lock);
+
+    fputs ("\n]}\n", trace_json);
+    fclose (trace_json);
+    trace_json = nullptr;
+
+    pthread_mutex_unlock (&trace_json_lock);
+}
+
+static void RequestDump (int signal)
+{
+    (void) signal;
+
+    trace_dump_requested = 1;
+}
+
+// a complete event, times are in microseconds from the start of the program
+static void WriteEvent (TracePhase phase, uint64_t start, uint64_t end)
+{
+    long tid = (long) syscall (SYS_gettid);
+
+    pthread_mutex_lock (&trace_json_lock);
+
+    if (trace_json)
+    {
+        fprintf (trace_json, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%ld}",
+                 trace_json_first ? "" : ",\n", trace_names[phase],
+                 (double) (start - trace_origin) / 1000, (double) (end - start) / 1000,
+                 (int) getpid (), tid);
+
+        trace_json_first = false;
+    }
+
+    pthread_mutex_unlock (&trace_json_lock);
+}
@@ -0,0 +1,471 @@
+#include "akinator.h"
+#include "journal.h"
+#include "search.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <unistd.h>
+
+static Node* NewNode     (arena* nodes, Node* parent);
+static Node* AncestorAt  (Node* node, size_t depth);
+static Node* NextSibling (Node* node, const Node* root, Way first);
+
+const size_t NODES_SLAB_SIZE = 4096 * sizeof (Node);
+const size_t STATS_SLAB_SIZE = 1024 * sizeof (NodeStats);
+
+const uint32_t SPLIT_BUSY = UINT32_MAX;    // the leaf is being split right now
+
+void TreeCtor (Tree* tree)
+{
+    assert (tree);
+
+    arena_ctor (&tree->nodes, NODES_SLAB_SIZE);
+    arena_ctor (&tree->stats, STATS_SLAB_SIZE);
+
+    tree->root = (Node*) arena_alloc (&tree->nodes, sizeof (Node), alignof (Node));
+    *tree->root = {};
+    SetJump (tree->root);
+
+    tree->format    = TEXT_BASE;
+    tree->search    = nullptr;
+    tree->journal   = nullptr;
+    tree->version   = 0;
+    tree->counted   = 0;
+    tree->snapshots = 0;
+
+    IndexCtor (&tree->index);
+}
+
+void TreeDtor (Tree* tree)
+{
+    assert (tree);
+    assert (__atomic_load_n (&tree->snapshots, __ATOMIC_ACQUIRE) == 0);
+
+    arena_dtor (&tree->nodes);
+    arena_dtor (&tree->stats);
+
+    IndexDtor (&tree->index);
+
+    SearchDtor (tree->search);
+    tree->search = nullptr;
+
+    tree->root = nullptr;
+}
+
+Node* CreateNode (Tree* tree, Node* parent, Way mode)
+{
+    assert (tree);
+
+    return CreateNodeIn (&tree->nodes, parent, mode);
+}
+
+// the loader builds subtrees in arenas of its own and hands them over to the tree later
+Node* CreateNodeIn (arena* nodes, Node* parent, Way mode)
+{
+    assert (nodes);
+    assert (parent);
+
+    Node* node = NewNode (nodes, parent);
+
+    if (mode == LEFT)
+        parent->left  = node;
+    else
+        parent->right = node;
+
+    return node;
+}
+
+// The leaf becomes the question, the old answer moves to its right child and the
+// new one goes to the left child. Both children are complete before they are linked
+// into the tree, and the leaf is renamed last, so a reader walking the tree never
+// meets a half-made node. The leaf is stamped with the new version in between, so
+// the snapshots taken before still see it as a leaf (see ViewNode).
+// Returns false if the new object has the same name as another answer.
+bool SplitLeaf (Tree* tree, Node* leaf, const char* object,   size_t object_len,
+                                        const char* question, size_t question_len)
+{
+    assert (tree);
+    assert (leaf);
+    assert (object);
+    assert (question);
+    assert (!leaf->left && !leaf->right);
+    assert (tree->version + 1 < SPLIT_BUSY);
+
+    Node* right = NewNode (&tree->nodes, leaf);
+    right->name  = leaf->name;
+    right->stats = leaf->stats;    // the counters stay with the object
+
+    Node* left = NewNode (&tree->nodes, leaf);
+    SetNodeName (tree, left, object, object_len);
+
+    IndexReplace (&tree->index, leaf, right);
+    bool indexed = IndexInsert (&tree->index, left);
+    if (indexed && tree->search) SearchAdd (tree->search, left->name);
+
+    __atomic_store_n (&leaf->split, SPLIT_BUSY, __ATOMIC_RELAXED);
+    __atomic_store_n (&leaf->right, right,      __ATOMIC_RELEASE);
+    __atomic_store_n (&leaf->left,  left,       __ATOMIC_RELEASE);
+    __atomic_store_n (&leaf->split, (uint32_t) (tree->version + 1), __ATOMIC_RELEASE);
+
+    __atomic_store_n (&leaf->name,  InternName (question, question_len), __ATOMIC_RELEASE);
+    __atomic_store_n (&leaf->stats, (NodeStats*) nullptr, __ATOMIC_RELEASE);
+
+    tree->version++;
+
+    // a record that did not reach the disk marks the journal as failed, the callers
+    // warn about it and save the whole base at exit
+    if (tree->journal && JournalAppend (tree->journal, leaf) &&
+        tree->journal->records >= JOURNAL_COMPACT_RECORDS) JournalStartCompact (tree->journal, tree);
+
+    return indexed;
+}
+
+static Node* NewNode (arena* nodes, Node* parent)
+{
+    Node* node = (Node*) arena_alloc (nodes, sizeof (Node), alignof (Node));
+    *node = {};
+
+    node->parent = parent;
+    node->depth  = parent->depth + 1;
+    SetJump (node);
+
+    return node;
+}
+
+void SetNodeName (Tree* tree, Node* node, const char* name, size_t len)
+{
+    assert (tree);
+    assert (node);
+    assert (name);
+
+    node->name = InternName (name, len);
+}
+
+// Skew-binary jump pointers: one pointer per node instead of a table of 2^k-th
+// ancestors, and a node gets it from its parent in O(1), so a split costs nothing
+// more. The jumps of a node and its ancestors cover the way to the root with
+// O(log depth) jumps of the sizes 1, 3, 7, ..., 2^k - 1, like binary lifting does.
+// The jump of a node depends on its depth only, so two nodes at one depth jump
+// to one depth. The parent has to be set and has to have its jump.
+void SetJump (Node* node)
+{
+    assert (node);
+
+    Node* parent = node->parent;
+
+    if (!parent)
+    {
+        node->jump = node;
+        return;
+    }
+
+    Node* jump = parent->jump;
+
+    // two jumps of one size make one of twice the size and one more
+    node->jump = (parent->depth - jump->depth == jump->depth - jump->jump->depth) ? jump->jump : parent;
+}
+
+// the ancestor of the node at the depth, in O(log depth)
+static Node* AncestorAt (Node* node, size_t depth)
+{
+    while (node->depth > depth)
+    {
+        node = (node->jump->depth >= depth) ? node->jump : node->parent;
+    }
+
+    return node;
+}
+
+// lowest common ancestor in O(log depth) along the jump pointers, no memory is allocated.
+// child_1 and child_2 get the children of the ancestor on the way to node_1 and node_2,
+// nullptr if the node is the ancestor itself
+Node* CommonAncestor (Node* node_1, Node* node_2, Node** child_1, Node** child_2)
+{
+    assert (node_1);
+    assert (node_2);
+    assert (child_1);
+    assert (child_2);
+
+    uint64_t start = TraceBegin ();
+
+    *child_1 = nullptr;
+    *child_2 = nullptr;
+
+    // one level below the other node first, in case that one is the ancestor
+    if (node_1->depth > node_2->depth)
+    {
+        *child_1 = AncestorAt (node_1, node_2->depth + 1);
+        node_1   = (*child_1)->parent;
+    }
+
+    if (node_2->depth > node_1->depth)
+    {
+        *child_2 = AncestorAt (node_2, node_1->depth + 1);
+        node_2   = (*child_2)->parent;
+    }
+
+    if (node_1 != node_2)
+    {
+        // climbs while the ancestor is still above, both nodes stay at one depth
+        while (node_1->parent != node_2->parent)
+        {
+            bool jump = node_1->jump != node_2->jump;
+
+            node_1 = jump ? node_1->jump : node_1->parent;
+            node_2 = jump ? node_2->jump : node_2->parent;
+        }
+
+        *child_1 = node_1;
+        *child_2 = node_2;
+        node_1   = node_1->parent;
+    }
+
+    TraceEnd (TRACE_COMPARE, start);
+
+    return node_1;
+}
+
+// pushes the way from the root to the node, the first step ends up on top
+void FindPath (Node* node, PathStack* path)
+{
+    assert (node);
+    assert (path);
+
+    uint64_t start = TraceBegin ();
+
+    for (; node->parent != nullptr; node = node->parent)
+    {
+        path->push ((node == node->parent->left) ? LEFT : RIGHT);
+    }
+
+    TraceEnd (TRACE_PATH, start);
+}
+
+// The next node of a pre-order walk over the subtree of root without going deeper
+// than max_depth below it. The first child is visited first, the walk climbs back
+// along the parent pointers, so it needs no stack at all.
+Node* NextPreOrder (Node* node, const Node* root, size_t max_depth, Way first)
+{
+    assert (node);
+    assert (root);
+
+    Node* first_child  = (first == LEFT) ? node->left  : node->right;
+    Node* second_child = (first == LEFT) ? node->right : node->left;
+
+    if (node->depth - root->depth < max_depth)
+    {
+        if (first_child)  return first_child;
+        if (second_child) return second_child;
+    }
+
+    return NextSibling (node, root, first);
+}
+
+// the same walk over the tree as the snapshot sees it
+Node* NextPreOrderIn (const Snapshot* snapshot, Node* node, const Node* root, size_t max_depth, Way first)
+{
+    assert (snapshot);
+    assert (node);
+    assert (root);
+
+    if (node->depth - root->depth < max_depth)
+    {
+        NodeView view = ViewNode (snapshot, node);
+
+        Node* first_child  = (first == LEFT) ? view.left  : view.right;
+        Node* second_child = (first == LEFT) ? view.right : view.left;
+
+        if (first_child)  return first_child;
+        if (second_child) return second_child;
+    }
+
+    return NextSibling (node, root, first);
+}
+
+// the parents of a node the walk has reached had their children before it did,
+// so the climb reads them as they are
+static Node* NextSibling (Node* node, const Node* root, Way first)
+{
+    while (node != root)
+    {
+        Node* parent = node->parent;
+        Node* second = (first == LEFT) ? parent->right : parent->left;
+
+        if (node != second && second) return second;
+
+        node = parent;
+    }
+
+    return nullptr;
+}
+
+void TakeSnapshot (Tree* tree, Snapshot* snapshot)
+{
+    assert (tree);
+    assert (snapshot);
+
+    snapshot->tree    = tree;
+    snapshot->root    = tree->root;
+    snapshot->version = tree->version;
+    snapshot->size    = tree->nodes.allocated;
+
+    __atomic_fetch_add (&tree->snapshots, 1, __ATOMIC_RELAXED);
+}
+
+// may be called on the thread that has read the snapshot
+void ReleaseSnapshot (Snapshot* snapshot)
+{
+    assert (snapshot);
+    assert (snapshot->tree);
+
+    __atomic_fetch_sub (&snapshot->tree->snapshots, 1, __ATOMIC_RELEASE);
+
+    *snapshot = {};
+}
+
+// A leaf is split in this order: the split field gets SPLIT_BUSY, the children are
+// linked, the field gets the version, the leaf gets the new name. So a reader that
+// finds no version in the field after reading the node has read it before the split,
+// and the right child with the old name is linked by the time the version is seen.
+NodeView ViewNode (const Snapshot* snapshot, const Node* node)
+{
+    assert (snapshot);
+    assert (node);
+
+    bool moved = false;    // to the right child, which has the name of a leaf split later
+
+    while (true)
+    {
+        NodeView view  = {};
+        uint32_t split = __atomic_load_n (&node->split, __ATOMIC_ACQUIRE);
+
+        if (split == 0 || split == SPLIT_BUSY)
+        {
+            view.right = __atomic_load_n (&node->right, __ATOMIC_ACQUIRE);
+            view.left  = __atomic_load_n (&node->left,  __ATOMIC_ACQUIRE);
+            view.name  = __atomic_load_n (&node->name,  __ATOMIC_ACQUIRE);
+
+            split = __atomic_load_n (&node->split, __ATOMIC_ACQUIRE);
+        }
+
+        if (split == 0 && !moved) return view;
+
+        if (split == 0 || split == SPLIT_BUSY) return {nullptr, nullptr, view.name};
+
+        // split before the snapshot was taken, nothing changes here anymore
+        if (split <= snapshot->version) return {node->right, node->left, node->name};
+
+        node  = __atomic_load_n (&node->right, __ATOMIC_ACQUIRE);
+        moved = true;
+    }
+}
+
+// the names are copied to the string table, so the file is let go right after parsing
+bool LoadTree (Tree* tree, const char* base)
+{
+    assert (tree);
+    assert (base);
+
+    TreeCtor (tree);
+
+    size_t size   = 0;
+    bool   mapped = true;
+    char*  buffer = map_file_content (base, &size);
+
+    if (!buffer)
+    {
+        mapped = false;
+        buffer = get_file_content (base, &size);
+        if (!buffer) return false;
+    }
+
+    uint64_t start  = TraceBegin ();
+    bool     parsed = false;
+
+    if (IsBinaryBase (buffer, size))
+    {
+        tree->format = BINARY_BASE;
+
+        parsed = GetTreeBinary (tree, buffer, size);
+        if (parsed) BuildIndex (tree);
+    }
+    else
+    {
+        parsed = GetTreeText (tree, buffer, size);
+    }
+
+    TraceEnd (TRACE_PARSE, start);
+
+    if (mapped)
+        unmap_file_content (buffer, size);
+    else
+        free (buffer);
+
+    return parsed;
+}
+
+bool SaveTree (Tree* tree, const char* base, BaseFormat format)
+{
+    assert (tree);
+    assert (base);
+
+    Snapshot snapshot = {};
+    TakeSnapshot (tree, &snapshot);
+
+    bool saved = SaveSnapshot (&snapshot, base, format);
+
+    ReleaseSnapshot (&snapshot);
+
+    return saved;
+}
+
+// the base is never truncated: the new content goes to a temporary file
+// which then replaces the base
+bool SaveSnapshot (const Snapshot* snapshot, const char* base, BaseFormat format)
+{
+    assert (snapshot);
+    assert (base);
+
+    if (is_special_file (base))
+    {
+        fprintf (stderr, "База %s не является обычным файлом, изменения не сохранены\n", base);
+        return false;
+    }
+
+    size_t tmp_len  = strlen (base) + sizeof (".tmp");
+    char*  tmp_name = (char*) calloc (tmp_len, sizeof (char));
+    assert (tmp_name);
+    snprintf (tmp_name, tmp_len, "%s.tmp", base);
+
+    FILE* file = fopen (tmp_name, (format == BINARY_BASE) ? "wb" : "w");
+    if (!file)
+    {
+        free (tmp_name);
+        return false;
+    }
+
+    // the text writer has a buffer of its own, through the one of stdio every chunk took two writes
+    if (format == TEXT_BASE) setvbuf (file, nullptr, _IONBF, 0);
+
+    uint64_t start = TraceBegin ();
+
+    if (format == BINARY_BASE)
+        PrintTreeBinary (snapshot, snapshot->root, file);
+    else
+        PrintTreeText (snapshot, file);
+
+    TraceEnd (TRACE_SERIALIZE, start);
+
+    bool saved = !ferror (file) && (fflush (file) == 0) && (fsync (fileno (file)) == 0);
+    saved = (fclose (file) == 0) && saved && (rename (tmp_name, base) == 0);
+    if (!saved) remove (tmp_name);
+
+    saved = saved && sync_parent_dir (base);
+
+    free (tmp_name);
+
+    return saved;
+}
@@ -5,36 +5,124 @@
 #include <cmath>
 #include <cctype>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
 #include "utils.h"
 
-char* get_file_content(const char* filename)
+const size_t READ_CHUNK_SIZE = 64 * 1024;
+
+char* get_file_content(const char* filename, size_t* size)
 {
     assert(filename);
+    assert(size);
+
+    uint64_t start = TraceBegin();
 
-    FILE* file = fopen(filename, "rb");
+    FILE* file = (strcmp(filename, "-") == 0) ? stdin : fopen(filename, "rb");
+    if (file == nullptr) return nullptr;
 
-    int file_size = get_file_size(file);
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t length   = 0;
 
-    char* buffer = (char*) calloc(file_size + 1, sizeof(char));
+    char* buffer = (char*) malloc(capacity + 1);
     assert(buffer);
 
-    buffer[file_size] = '\0';
-    fread(buffer, sizeof(char), file_size, file);
+    size_t nread = 0;
+    while ((nread = fread(buffer + length, sizeof(char), capacity - length, file)) > 0)
+    {
+        length += nread;
+
+        if (length == capacity)
+        {
+            capacity *= 2;
+            buffer = (char*) realloc(buffer, capacity + 1);
+            assert(buffer);
+        }
+    }
+
+    buffer[length] = '\0';
+    *size = length;
+
+    if (file != stdin) fclose(file);
 
-    fclose(file);
+    TraceEnd(TRACE_READ, start);
 
     return buffer;
 }
 
-int get_file_size(FILE* file)
+char* map_file_content(const char* filename, size_t* size)
 {
-    assert(file);
+    assert(filename);
+    assert(size);
+
+    uint64_t start = TraceBegin();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) return nullptr;
+
+    madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+
+    *size = (size_t) info.st_size;
+
+    TraceEnd(TRACE_READ, start);
+
+    return (char*) data;
+}
+
+void unmap_file_content(char* data, size_t size)
+{
+    assert(data);
+
+    munmap(data, size);
+}
+
+// "-", pipes, devices and so on: everything that exists but is not a regular file
+bool is_special_file(const char* filename)
+{
+    assert(filename);
+
+    if (strcmp(filename, "-") == 0) return true;
+
+    struct stat info = {};
+    return stat(filename, &info) == 0 && !S_ISREG(info.st_mode);
+}
+
+// makes a rename of the file durable, the new name is in the directory entry
+bool sync_parent_dir(const char* filename)
+{
+    assert(filename);
+
+    const char* slash = strrchr(filename, '/');
+
+    char* dir = (slash == nullptr) ? strdup(".")
+                                   : strndup(filename, (slash == filename) ? 1 : (size_t) (slash - filename));
+    assert(dir);
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+
+    if (fd < 0) return false;
 
-    fseek(file, 0, SEEK_END);
-    int position = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    bool synced = fsync(fd) == 0;
+    close(fd);
 
-    return position;
+    return synced;
 }
 
 int calc_nlines(char* buffer)
@@ -61,5 +149,6 @@ bool is_equal(double a, double b)
 
 void ClearBuffer ()
 {
-    while (getchar () != '\n');
+    int ch = 0;
+    while ((ch = getchar ()) != '\n' && ch != EOF) {}
 }